@@ -0,0 +1,171 @@
+/**
+ * Microbenchmark: vector instructions against the interpreted loops they
+ * replace. Build from the repository root with
+ *
+ *   cc -Iinclude -std=c11 -O2 -o vector_bench bench/vector_bench.c \
+ *      $(find src -name '*.c' ! -name main.c) -lm -ldl
+ *
+ * and run ./vector_bench [elements]. Each program allocates its arrays,
+ * runs one pass over them and halts; the interpreted and vector versions of
+ * a kernel must leave the same value on the stack.
+ **/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../include/ijvm_ext.h"
+
+#define RUNS 5
+
+typedef struct {
+    byte_t text[256];
+    int size;
+} program_t;
+
+static void emit(program_t* p, int b) { p->text[p->size++] = (byte_t)b; }
+static void emit16(program_t* p, int v) { emit(p, (v >> 8) & 0xFF); emit(p, v & 0xFF); }
+
+// Locals of every program
+enum { A, B, C, I, SUM };
+
+static void load(program_t* p, int local) { emit(p, OP_ILOAD); emit(p, local); }
+static void store(program_t* p, int local) { emit(p, OP_ISTORE); emit(p, local); }
+static void push_n(program_t* p) { emit(p, OP_LDC_W); emit16(p, 0); }
+
+// a, b and c get n elements each; a and b are filled with 3 and 5
+static void prologue(program_t* p) {
+    for (int local = A; local <= C; local++) {
+        push_n(p);
+        emit(p, OP_NEWARRAY);
+        store(p, local);
+    }
+    for (int local = A; local <= B; local++) {
+        load(p, local);
+        emit(p, OP_BIPUSH); emit(p, 0);
+        push_n(p);
+        emit(p, OP_BIPUSH); emit(p, local == A ? 3 : 5);
+        emit(p, OP_ARRAYFILL);
+    }
+}
+
+// for (i = 0; i != n; i++) { body }, then the value of `result`
+static void counted_loop(program_t* p, void (*body)(program_t*), int result) {
+    int loop = p->size;
+    load(p, I);
+    push_n(p);
+    int exit_branch = p->size;
+    emit(p, OP_IF_ICMPEQ); emit16(p, 0);
+    body(p);
+    emit(p, OP_IINC); emit(p, I); emit(p, 1);
+    emit(p, OP_GOTO); emit16(p, loop - p->size + 1);
+    int done = p->size;
+    p->text[exit_branch + 1] = (byte_t)(((done - exit_branch) >> 8) & 0xFF);
+    p->text[exit_branch + 2] = (byte_t)((done - exit_branch) & 0xFF);
+    load(p, result);
+    emit(p, OP_HALT);
+}
+
+// c[i] = a[i] + b[i]
+static void add_body(program_t* p) {
+    load(p, I); load(p, A); emit(p, OP_IALOAD);
+    load(p, I); load(p, B); emit(p, OP_IALOAD);
+    emit(p, OP_IADD);
+    load(p, I); load(p, C); emit(p, OP_IASTORE);
+}
+
+// sum += a[i]
+static void sum_body(program_t* p) {
+    load(p, SUM);
+    load(p, I); load(p, A); emit(p, OP_IALOAD);
+    emit(p, OP_IADD);
+    store(p, SUM);
+}
+
+static void interpreted_add(program_t* p) {
+    prologue(p);
+    counted_loop(p, add_body, I);
+}
+
+static void vector_add(program_t* p) {
+    prologue(p);
+    load(p, A); load(p, B); load(p, C);
+    emit(p, OP_BIPUSH); emit(p, 0);
+    push_n(p);
+    emit(p, OP_VECOP); emit(p, VEC_ADD);
+    // leave n on the stack, like the loop leaves i
+    push_n(p);
+    emit(p, OP_HALT);
+}
+
+static void interpreted_sum(program_t* p) {
+    prologue(p);
+    counted_loop(p, sum_body, SUM);
+}
+
+static void vector_sum(program_t* p) {
+    prologue(p);
+    load(p, A);
+    emit(p, OP_BIPUSH); emit(p, 0);
+    push_n(p);
+    emit(p, OP_VECREDUCE); emit(p, VEC_SUM);
+    emit(p, OP_HALT);
+}
+
+static void put32(FILE* f, uint32_t v) {
+    fputc((int)(v >> 24), f); fputc((int)(v >> 16) & 0xFF, f);
+    fputc((int)(v >> 8) & 0xFF, f); fputc((int)v & 0xFF, f);
+}
+
+static void write_binary(const char* path, const program_t* p, int n) {
+    FILE* f = fopen(path, "wb");
+    put32(f, MAGIC_NUMBER);
+    put32(f, 0x10000); put32(f, 4); put32(f, (uint32_t)n);
+    put32(f, 0); put32(f, (uint32_t)p->size);
+    fwrite(p->text, 1, (size_t)p->size, f);
+    fclose(f);
+}
+
+static double now_ms(void) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (double)ts.tv_sec * 1e3 + (double)ts.tv_nsec / 1e6;
+}
+
+// Best of RUNS, in milliseconds; *result gets the top of the stack
+static double time_program(void (*build)(program_t*), int n, word* result) {
+    program_t p;
+    memset(&p, 0, sizeof(p));
+    build(&p);
+    char path[] = "vector_bench.ijvm";
+    write_binary(path, &p, n);
+
+    double best = -1;
+    for (int r = 0; r < RUNS; r++) {
+        ijvm* m = init_ijvm(path, stdin, stdout);
+        double start = now_ms();
+        run(m);
+        double elapsed = now_ms() - start;
+        *result = tos(m);
+        destroy_ijvm(m);
+        if (best < 0 || elapsed < best) best = elapsed;
+    }
+    remove(path);
+    return best;
+}
+
+static void compare(const char* name, void (*interpreted)(program_t*),
+                    void (*vector)(program_t*), int n) {
+    word slow_result, fast_result;
+    double slow = time_program(interpreted, n, &slow_result);
+    double fast = time_program(vector, n, &fast_result);
+    printf("%-4s %9.3f ms interpreted %9.3f ms vector %7.1fx %s\n", name, slow, fast,
+           slow / fast, slow_result == fast_result ? "" : "RESULTS DIFFER");
+}
+
+int main(int argc, char** argv) {
+    int n = argc > 1 ? atoi(argv[1]) : 1000000;
+    printf("%d elements, best of %d runs (allocation included)\n", n, RUNS);
+    compare("add", interpreted_add, vector_add, n);
+    compare("sum", interpreted_sum, vector_sum, n);
+    return 0;
+}
@@ -0,0 +1,40 @@
+#ifndef ARENA_H
+#define ARENA_H
+#include <stddef.h>
+#include "ijvm_struct.h"
+
+// Per-VM region allocator. Everything a VM owns for its whole life (slab
+// chunks, side tables, the nursery, text and constant pool) comes out of
+// fixed-size regions that release_arena() hands back all at once to a
+// process-wide pool, where the next VM picks them up again. Allocations
+// larger than ARENA_LARGE_BYTES get a block of their own, pooled as well.
+#define ARENA_REGION_BYTES (64 * 1024)
+#define ARENA_LARGE_BYTES (ARENA_REGION_BYTES / 4)
+
+// The first arena_alloc() of an arena without regions is served from a
+// dedicated block of this size instead, so creating a VM that never
+// allocates an object does not take a region out of the pool.
+#define ARENA_FIRST_BYTES 1024
+
+// Most memory the pool keeps around: a number of regions, plus dedicated
+// blocks up to a total size. Blocks larger than ARENA_POOL_MAX_LARGE are
+// never pooled. The rest goes back to the system.
+#define ARENA_POOL_REGIONS 256
+#define ARENA_POOL_LARGE_BYTES (16 * 1024 * 1024)
+#define ARENA_POOL_MAX_LARGE (ARENA_POOL_LARGE_BYTES / 4)
+
+void init_arena(arena_t* arena);
+
+// Returns `bytes` bytes, 16-byte aligned and not initialised, that stay
+// valid until release_arena(). NULL when no memory is left.
+void* arena_alloc(arena_t* arena, size_t bytes);
+
+// Returns a whole region of ARENA_REGION_BYTES bytes, which can be given
+// back early with arena_free_region().
+void* arena_region(arena_t* arena);
+void arena_free_region(arena_t* arena, void* region);
+
+// Returns every region and block of the arena to the pool.
+void release_arena(arena_t* arena);
+
+#endif
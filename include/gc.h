@@ -0,0 +1,79 @@
+#ifndef GC_H
+#define GC_H
+#include "ijvm.h"
+
+// Incremental collection phases
+#define GC_IDLE 0
+#define GC_MARKING 1
+
+// Number of recent pauses kept for get_gc_pause_stats()
+#define GC_PAUSE_SAMPLES 1024
+
+// Runs a full mark-sweep collection. Roots are found by scanning the operand
+// stack, which holds all frames and their locals. With options.precise_gc
+// only slots tagged as references (see Stack.tags and heap_object_t.tags)
+// are followed; otherwise any word that resolves through the handle table
+// keeps its array alive, as does any such word stored inside a live array.
+// With options.gc_threads above one, large heaps are marked and swept in
+// parallel (see gc_parallel.h). Surviving nursery objects are promoted and
+// the nursery is emptied. An
+// incremental cycle in progress is abandoned and redone from scratch.
+// With options.reference_counting every count is rebuilt (see refcount.h).
+// Afterwards the old space is compacted (see compact_heap() in ijvm_ext.h)
+// if more than options.compact_percent of the slab space is unused.
+void collect_garbage(ijvm* m);
+
+// Runs a minor collection: only nursery objects are marked, with the stack
+// and the remembered set (old objects written to by IASTORE since the last
+// collection) as roots. Survivors are promoted to the old space, so its cost
+// tracks the amount of live young data.
+void collect_young(ijvm* m);
+
+// Starts an incremental tri-color cycle over the old space by greying the
+// objects the stack refers to. The cycle then advances through gc_slice().
+void start_incremental_gc(ijvm* m);
+
+// Scans at most options.gc_slice_objects grey objects (and stays within
+// options.gc_slice_micros, if set). When no grey objects are left the roots
+// are rescanned, the nursery is evacuated and the old space is swept.
+void gc_slice(ijvm* m);
+
+// Insertion barrier for incremental marking: greys the old object `value`
+// refers to if it has not been reached yet. Called when a reference is
+// stored into an array while a cycle is running.
+void shade_reference(ijvm* m, word value, uint8_t tag);
+
+// Allocation-pressure policy, called by NEWARRAY before `bytes` of array
+// data are allocated. Collects when the allocation would cross the heap or
+// array limits, or when the bytes that entered the old space since the last
+// full collection reach gc_growth_factor times the bytes that survived it
+// (and at least gc_min_trigger_bytes). Every decision is reported to
+// options.gc_hook.
+void collect_if_needed(ijvm* m, size_t bytes);
+
+// True if `bytes` more heap bytes stay within limits.max_heap_bytes.
+bool heap_limit_allows(ijvm* m, size_t bytes);
+
+// Collects because of `trigger`: a full collection, or the start of an
+// incremental cycle when that mode is enabled and the trigger allows it.
+void request_collection(ijvm* m, gc_trigger trigger);
+
+// Called by the scanners below for every word that may be a reference;
+// `data` is passed through unchanged.
+typedef void (*mark_fn)(ijvm* m, word value, void* data);
+
+// Calls `mark` on every stack slot that may refer to an object. With
+// options.precise_gc only slots tagged as references are visited.
+void scan_roots(ijvm* m, mark_fn mark, void* data);
+
+// Calls `mark` on every word inside `obj` that may be a reference, following
+// the same rules as scan_roots().
+void scan_object(ijvm* m, heap_object_t* obj, mark_fn mark, void* data);
+
+// Pushes `obj` onto a mark stack, growing it as needed.
+void mark_push(mark_stack_t* stack, heap_object_t* obj);
+
+// Frees the collector's own bookkeeping.
+void destroy_gc(ijvm* m);
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef GC_PARALLEL_H
+#define GC_PARALLEL_H
+#include "ijvm.h"
+
+// Full collections only go parallel once the handle table is this large;
+// below that, starting threads costs more than it saves.
+#define PARALLEL_GC_MIN_HANDLES 4096
+#define PARALLEL_GC_MAX_THREADS 64
+
+// Marks everything reachable from the stack on `threads` threads (the
+// calling one included) while the mutator is stopped. Each worker traces
+// from its own mark stack and offers part of it to the others once it grows;
+// workers that run dry steal from them. Mark bits are set atomically, so
+// every object is scanned once. Returns false, with every mark bit clear,
+// if the work lists could not be allocated; the caller then marks serially.
+bool parallel_mark(ijvm* m, int threads);
+
+// Splits the handle table into `threads` ranges. The workers clear the mark
+// bits of surviving old objects and collect the dead ones, which are then
+// freed on the calling thread in slot order. Returns false, having done
+// nothing, if the ranges could not be allocated.
+bool parallel_sweep(ijvm* m, int threads);
+
+#endif
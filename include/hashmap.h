@@ -0,0 +1,59 @@
+#ifndef HASHMAP_H
+#define HASHMAP_H
+#include "ijvm.h"
+
+// heap_object_t.type of a hash map. Maps share handles, spaces and the
+// collector with arrays but have no elements (size is 0). Their data is a
+// hash_map_t header; the entry table it points to is malloc'd, so moving
+// the object (promotion, compaction) moves the map along with it.
+#define TYPE_MAP 0x80
+
+#define MAP_EMPTY 0
+#define MAP_FULL 1
+#define MAP_DELETED 2
+
+typedef struct {
+    word key;
+    word value;
+    uint8_t state;      // MAP_EMPTY, MAP_FULL or MAP_DELETED
+    uint8_t key_tag;    // reference tags, see Stack.tags
+    uint8_t value_tag;
+} map_entry_t;
+
+typedef struct {
+    map_entry_t* entries; // open addressing with linear probing, NULL while empty
+    int capacity;         // a power of two
+    int count;            // MAP_FULL entries
+    int used;             // MAP_FULL plus MAP_DELETED entries
+} hash_map_t;
+
+static inline hash_map_t* map_of(heap_object_t* obj) {
+    return (hash_map_t*)obj->data;
+}
+
+// Allocates an empty map, or returns NULL like new_array().
+heap_object_t* new_map(ijvm* m);
+
+// Looks up `key`. Returns false if it is absent.
+bool map_get(heap_object_t* obj, word key, word* value, uint8_t* value_tag);
+
+// Bytes by which map_put() of `key` would grow the entry table, so the
+// caller can check the heap budget first.
+size_t map_put_bytes(heap_object_t* obj, word key);
+
+// Inserts or replaces the value of `key`, running the write barrier for
+// both and growing the table as needed. Returns false, leaving the map
+// unchanged, if the table could not grow.
+bool map_put(ijvm* m, heap_object_t* obj, word key, uint8_t key_tag,
+             word value, uint8_t value_tag);
+
+// Removes `key`. Returns false if it was absent.
+bool map_remove(ijvm* m, heap_object_t* obj, word key);
+
+// Bytes of the entry table, which count towards m->heap_bytes.
+size_t map_table_bytes(heap_object_t* obj);
+
+// Frees the entry table.
+void free_map(ijvm* m, heap_object_t* obj);
+
+#endif
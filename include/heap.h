@@ -0,0 +1,100 @@
+#ifndef HEAP_H
+#define HEAP_H
+#include <stdint.h>
+#include "ijvm.h"
+
+// Array references are handles: the low HANDLE_INDEX_BITS select a slot in
+// m->heap and the bits above hold the slot's generation. Freeing an object
+// bumps the generation of its slot, so stale references no longer match
+// and the slot can be recycled safely. Generations run from 1 to
+// HANDLE_GENERATION_MASK, which keeps references positive and well away
+// from small integers. A slot whose generation would wrap is set aside as
+// exhausted instead of going back on the free list, until
+// recycle_exhausted_handles() has checked that no old reference to it is
+// left anywhere.
+#define HANDLE_INDEX_BITS 24
+#define HANDLE_INDEX_MASK ((1 << HANDLE_INDEX_BITS) - 1)
+#define HANDLE_GENERATION_MASK 0x7F
+#define MAX_HEAP_HANDLES (1 << HANDLE_INDEX_BITS)
+
+// Where an object lives. Objects are a single block with their data directly
+// behind the header: nursery objects are bump-allocated, old objects come
+// from the slab allocator.
+#define SPACE_OLD 0
+#define SPACE_NURSERY 1
+
+// Arrays larger than this fraction of the nursery are allocated old.
+#define NURSERY_PRETENURE_FRACTION 4
+
+// Largest element count whose object size still fits in a size_t.
+#define MAX_ARRAY_WORDS ((SIZE_MAX - sizeof(heap_object_t)) / sizeof(word))
+
+// Allocates a zeroed array of `count` words and returns it, or NULL if the
+// handle table or memory is exhausted.
+heap_object_t* new_array(ijvm* m, word count);
+
+// Like new_array(), for `count` elements of ATYPE_ type `type`.
+heap_object_t* new_typed_array(ijvm* m, uint8_t type, word count);
+
+// Bytes per element of an ATYPE_ type.
+size_t element_bytes(uint8_t type);
+
+// Gives obj a zeroed reference tag per element, unless it has them already,
+// and returns them.
+uint8_t* alloc_tags(ijvm* m, heap_object_t* obj);
+
+// Returns the live object `ref` refers to, or NULL for stale or forged
+// references.
+heap_object_t* find_heap_object(ijvm* m, word ref);
+
+// Frees an object and recycles its handle slot.
+void free_heap_object(ijvm* m, heap_object_t* obj);
+
+// Puts exhausted handle slots back on the free list, restarting at
+// generation 1, once there are enough of them to be worth it. Slots that a
+// word on the stack or in a live object could still refer to stay
+// exhausted.
+void recycle_exhausted_handles(ijvm* m);
+
+// Dead objects whose memory each old-space allocation or minor collection
+// releases, see retire_heap_object()
+#define LAZY_FREE_BATCH 8
+
+// Recycles the handle slot of a dead old object right away, so references
+// to it stop resolving, but only queues its memory on m->retired. Sweeping
+// uses this to keep the frees out of the collection pause; the queue is
+// worked off a few objects per old-space allocation and minor collection,
+// and whatever is left is released before the next sweep.
+void retire_heap_object(ijvm* m, heap_object_t* obj);
+
+// Releases the memory of up to `budget` retired objects, all of them if
+// `budget` is negative.
+void release_retired(ijvm* m, int budget);
+
+// Bytes of element data in an array of `count` elements of type `type`.
+size_t array_data_bytes(uint8_t type, int count);
+
+// Bytes such an array occupies, header included.
+size_t object_bytes(uint8_t type, int count);
+
+// Bytes it occupies in the nursery, including padding.
+size_t nursery_footprint(uint8_t type, int count);
+
+// Copies a surviving nursery object into the old space, repoints its
+// handle at the copy and returns the copy, or NULL if the old space is out
+// of memory (the object is then left as it was).
+heap_object_t* promote_object(ijvm* m, heap_object_t* obj);
+
+// Must be called after `value` (with reference tag `tag`) is stored into
+// `obj`, so that old-to-young references are found by minor collections
+// and a running incremental cycle does not miss the stored reference.
+void write_barrier(ijvm* m, heap_object_t* obj, word value, uint8_t tag);
+
+// write_barrier() for `count` elements of `obj` starting at `from`, after
+// they were overwritten in bulk.
+void write_barrier_range(ijvm* m, heap_object_t* obj, int from, int count);
+
+// Frees every object and the handle table itself.
+void destroy_heap(ijvm* m);
+
+#endif
@@ -0,0 +1,148 @@
+#ifndef IJVM_EXT_H
+#define IJVM_EXT_H
+
+#include <stddef.h>
+#include "ijvm.h"
+
+/**
+ * Runtime extensions on top of the assignment interface in ijvm.h.
+ * These are not used by the course tests.
+ **/
+
+
+/**
+ * Typed arrays. OP_NEWTARRAY takes an element type operand byte (numbered
+ * like the JVM's newarray) and pops the element count. The byte and short
+ * loads and stores pop like OP_IALOAD/OP_IASTORE and only accept arrays of
+ * their width; loads sign- or zero-extend as the element type says, stores
+ * truncate. Typed arrays cannot hold references.
+ **/
+#define OP_NEWTARRAY      ((byte_t) 0xD5)
+#define OP_BALOAD         ((byte_t) 0xD6)
+#define OP_BASTORE        ((byte_t) 0xD7)
+#define OP_SALOAD         ((byte_t) 0xD8)
+#define OP_SASTORE        ((byte_t) 0xD9)
+
+#define ATYPE_UBYTE  4   // unsigned 8-bit, in the JVM's boolean slot
+#define ATYPE_CHAR   5   // unsigned 16-bit
+#define ATYPE_BYTE   8   // signed 8-bit
+#define ATYPE_SHORT  9   // signed 16-bit
+#define ATYPE_INT   10   // word_t, what OP_NEWARRAY creates
+
+/**
+ * Bulk array operations, each a single bounds check plus a memmove or fill.
+ * OP_ARRAYCOPY pops length, destination offset, destination, source offset
+ * and source (pushed in the opposite order); the two arrays must have
+ * elements of the same width and may overlap. OP_ARRAYFILL pops value,
+ * length, offset and array, and stores the (truncated) value into every
+ * element of the range.
+ **/
+#define OP_ARRAYCOPY      ((byte_t) 0xDA)
+#define OP_ARRAYFILL      ((byte_t) 0xDB)
+
+/**
+ * Vector instructions over ranges of word arrays, with the operation in an
+ * operand byte. OP_VECOP pops length, offset, destination and the arrays b
+ * and a, and sets dst[i] = a[i] op b[i] over the range (VEC_ADD, VEC_SUB,
+ * VEC_AND or VEC_OR). OP_VECREDUCE pops length, offset and array and pushes
+ * the range's VEC_SUM, VEC_MIN or VEC_MAX. Results wrap around exactly
+ * like the equivalent IADD/ISUB loop.
+ **/
+#define OP_VECOP          ((byte_t) 0xDC)
+#define OP_VECREDUCE      ((byte_t) 0xDD)
+
+#define VEC_ADD 0
+#define VEC_SUB 1
+#define VEC_AND 2
+#define VEC_OR  3
+
+#define VEC_SUM 0
+#define VEC_MIN 1
+#define VEC_MAX 2
+
+/**
+ * Int-to-int hash maps, allocated and collected like arrays. OP_NEWMAP
+ * pushes a new empty map. OP_MAPGET pops map and key and pushes the value,
+ * or 0 for an absent key. OP_MAPPUT pops map, key and value (pushed like
+ * OP_IASTORE's operands). OP_MAPREMOVE pops map and key and pushes 1 if the
+ * key was present, else 0. OP_MAPSIZE pops a map and pushes its entry count.
+ **/
+#define OP_NEWMAP         ((byte_t) 0xE6)
+#define OP_MAPGET         ((byte_t) 0xE7)
+#define OP_MAPPUT         ((byte_t) 0xE8)
+#define OP_MAPREMOVE      ((byte_t) 0xE9)
+#define OP_MAPSIZE        ((byte_t) 0xEA)
+
+
+/**
+ * Fills opts with the defaults used by init_ijvm().
+ **/
+void default_ijvm_options(ijvm_options* opts);
+
+/**
+ * Like init_ijvm(), but with tunable initial sizes. Passing NULL for opts
+ * is the same as calling init_ijvm().
+ *
+ * Returns  - A pointer to an ijvm struct on success
+ *          - NULL on failure
+ **/
+ijvm* init_ijvm_with_options(char *binary_path, FILE* input, FILE* output,
+                             const ijvm_options* opts);
+
+/**
+ * Returns why the machine stopped, or IJVM_HALT_NONE while it can still run.
+ * Budget violations (see ijvm_limits) each have their own reason.
+ **/
+ijvm_halt_reason get_halt_reason(ijvm* m);
+
+/**
+ * Returns the number of bytes currently allocated for the operand stack.
+ * This drops again after deep recursion has unwound for a while.
+ **/
+size_t get_stack_committed_bytes(ijvm* m);
+
+/**
+ * Returns the largest number of bytes ever allocated for the operand stack.
+ **/
+size_t get_stack_peak_bytes(ijvm* m);
+
+/**
+ * Fills stats with collector pause times: every minor collection, full
+ * collection and incremental slice counts as one pause. Percentiles cover
+ * the most recent GC_PAUSE_SAMPLES pauses.
+ **/
+void get_gc_pause_stats(ijvm* m, gc_pause_stats* stats);
+
+/**
+ * destroy_ijvm() keeps the memory of the VM in a process-wide pool for the
+ * next init_ijvm(). This frees whatever the pool holds right now.
+ **/
+void trim_arena_pool(void);
+
+/**
+ * Fills stats with collection counts, pause times (see get_gc_pause_stats())
+ * and heap sizes. options.heap_stats_hook receives the same numbers after
+ * every minor collection, full collection and finished incremental cycle.
+ **/
+void get_heap_stats(ijvm* m, heap_stats* stats);
+
+/**
+ * Runs a full garbage collection and then compacts the old space, so that
+ * the memory of long-dead arrays goes back to the system. References held
+ * by the program stay valid.
+ **/
+void compact_heap(ijvm* m);
+
+/**
+ * Writes the allocation-site profile (see options.heap_profile) to out in
+ * folded-stack format, one line per site and metric:
+ *
+ *   live_bytes;main;method@0x001c;alloc@0x0047 4096
+ *
+ * The first frame names the metric: live_bytes, allocations or
+ * avg_lifetime (objects allocated while a freed object was alive). Does
+ * nothing when profiling is off.
+ **/
+void dump_heap_profile(ijvm* m, FILE* out);
+
+#endif
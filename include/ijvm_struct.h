@@ -11,16 +11,178 @@
 
 typedef struct {
     word *elements;
+    uint8_t *tags;       // 1 where the element holds an array reference
     int top;
     int capacity;
+    int min_capacity;    // never shrink below this
+    int peak_capacity;   // high-water mark of capacity
+    int low_water_ticks; // consecutive returns spent below 1/4 of capacity
+    int max_capacity;    // 0 means unlimited
+    bool overflowed;     // set when a push was refused by max_capacity
 } Stack;
 
 typedef struct {
     word reference;  // Unique identifier for this heap object
     word* data;      // The actual array data
     int size;          // The number of elements in the array
+    uint8_t type;      // Element type, one of the ATYPE_ values in ijvm_ext.h
+    uint8_t* tags;     // Reference tag per element, NULL until a reference is stored
+    bool marked;       // Reached during the current garbage collection
+    uint8_t space;     // SPACE_NURSERY or SPACE_OLD, see heap.h
+    bool remembered;   // Old object listed in the remembered set
+    bool zero_count;   // Listed in the zero-count table, see refcount.h
+    uint32_t refcount; // References held by heap objects, see refcount.h
 } heap_object_t;
 
+// One entry of the heap handle table. A reference names a slot plus the
+// generation the slot had when the object was allocated, see heap.h.
+typedef struct {
+    heap_object_t* object; // NULL while the slot is free
+    uint8_t generation;    // bumped when the object is freed
+    int next_free;         // next free slot while this one is free, -1 ends
+} heap_handle_t;
+
+// Header in front of every region and dedicated block of an arena, see
+// arena.h
+typedef struct arena_block {
+    struct arena_block* prev;
+    struct arena_block* next;
+    size_t bytes;        // usable bytes after the header
+    size_t padding;      // keeps what follows 16-byte aligned
+} arena_block_t;
+
+typedef struct {
+    arena_block_t* regions;     // newest first
+    arena_block_t* last_region;
+    int region_count;
+    arena_block_t* large;       // dedicated blocks, linked through next
+    byte* bump;                 // free part of the newest arena_alloc() region
+    byte* bump_end;
+} arena_t;
+
+// Per-class state of the slab allocator, see slab.h
+#define SLAB_CLASS_COUNT 13
+
+typedef struct {
+    void* free_list;     // recycled blocks, linked through their first word
+    byte* bump;          // next never-used block in the newest chunk
+    byte* bump_end;
+} slab_class_t;
+
+typedef struct {
+    slab_class_t classes[SLAB_CLASS_COUNT];
+    void* chunks;        // every chunk, linked through its first word
+    size_t committed;    // bytes held in chunks
+    size_t used;         // bytes of chunk blocks currently handed out
+    int outside;         // live blocks too large for a chunk
+    arena_t* arena;      // where chunks come from
+} slab_allocator_t;
+
+// Work list of grey objects for the collector
+typedef struct {
+    heap_object_t** items;
+    int size;
+    int capacity;
+} mark_stack_t;
+
+// Collector pause times in nanoseconds, see get_gc_pause_stats()
+typedef struct {
+    long long count;     // pauses since the VM started
+    uint32_t p50_ns;     // percentiles over the most recent pauses
+    uint32_t p99_ns;
+    uint32_t max_ns;
+} gc_pause_stats;
+
+// Why the runtime decided to collect, see ijvm_options.gc_hook
+typedef enum {
+    GC_TRIGGER_GROWTH,      // old space grew by gc_growth_factor times the live size
+    GC_TRIGGER_HEAP_CAP,    // the allocation would cross limits.max_heap_bytes
+    GC_TRIGGER_ARRAY_CAP,   // the allocation would cross limits.max_live_arrays
+    GC_TRIGGER_HANDLES      // the handle table is full
+} gc_trigger;
+
+typedef struct {
+    gc_trigger trigger;
+    size_t allocated_since_gc; // bytes that entered the old space since the last full collection
+    size_t live_after_gc;      // bytes that survived the last full collection
+    size_t threshold;          // allocated_since_gc that triggers a growth collection
+    size_t heap_bytes;         // bytes of array data right now
+} gc_decision;
+
+struct IJVM;
+typedef void (*gc_hook_fn)(struct IJVM* m, const gc_decision* decision, void* data);
+
+// Heap and collector counters, see get_heap_stats()
+typedef struct {
+    long long minor_collections;
+    long long full_collections;       // compactions included
+    long long incremental_cycles;     // completed ones
+    long long reconciliations;        // reference counting batches
+    long long pauses;                 // as in gc_pause_stats
+    uint32_t pause_p50_ns;
+    uint32_t pause_p99_ns;
+    uint32_t pause_max_ns;
+    unsigned long long bytes_allocated; // array data and map tables, ever
+    unsigned long long bytes_freed;
+    int live_objects;
+    size_t live_bytes;
+    int heap_size;                    // handle slots in use or on the free list
+    int heap_capacity;                // handle slots allocated
+    size_t slab_committed_bytes;      // old-space chunks
+    size_t nursery_bytes;             // young generation, once allocated
+} heap_stats;
+
+typedef void (*heap_stats_hook_fn)(struct IJVM* m, const heap_stats* stats, void* data);
+
+// Why the machine stopped, see get_halt_reason()
+typedef enum {
+    IJVM_HALT_NONE = 0,          // still running
+    IJVM_HALT_NORMAL,            // HALT instruction or end of text
+    IJVM_HALT_ERROR,             // ERR, invalid instruction or runtime error
+    IJVM_HALT_STACK_LIMIT,       // limits.max_stack_words exceeded
+    IJVM_HALT_HEAP_LIMIT,        // limits.max_heap_bytes exceeded
+    IJVM_HALT_ARRAY_LIMIT,       // limits.max_live_arrays exceeded
+    IJVM_HALT_INSTRUCTION_LIMIT  // limits.max_instructions exceeded
+} ijvm_halt_reason;
+
+// Per-VM resource budgets, 0 means unlimited
+typedef struct {
+    int max_stack_words;         // operand stack capacity, frames included
+    size_t max_heap_bytes;       // bytes of live array data
+    int max_live_arrays;         // number of live arrays
+    long long max_instructions;  // charged at back-edges and calls
+} ijvm_limits;
+
+// Tunables for init_ijvm_with_options(), see default_ijvm_options()
+typedef struct {
+    int initial_stack_words;  // initial operand stack capacity, grows on demand
+    int main_frame_slots;     // zeroed slots reserved for the main frame's locals
+    int initial_heap_objects; // heap table capacity, allocated on first NEWARRAY
+    bool precise_gc;          // trace only tagged slots instead of every word
+    size_t nursery_bytes;     // size of the young generation, 0 disables it
+    bool incremental_gc;      // mark the old space in slices instead of all at once
+    int gc_slice_objects;     // objects scanned per incremental slice
+    int gc_slice_micros;      // time budget per slice, 0 for no time limit
+    int compact_percent;      // compact after a full collection once this share
+                              // of the slab space is unused, 0 never
+    int gc_threads;           // threads marking and sweeping a full collection, 1 serial
+    bool reference_counting;  // free arrays by deferred reference counting, see
+                              // refcount.h; implies precise_gc, no nursery and
+                              // no incremental_gc
+    int rc_batch_objects;     // zero-count entries that trigger a reconciliation
+    double gc_growth_factor;  // collect once the old space grew by this times the live size
+    size_t gc_min_trigger_bytes; // but never before this many bytes were allocated
+    gc_hook_fn gc_hook;       // called with every automatic collection decision
+    void* gc_hook_data;
+    heap_stats_hook_fn heap_stats_hook; // called after every completed collection
+    void* heap_stats_hook_data;
+    bool heap_profile;        // record allocation sites, see dump_heap_profile()
+    FILE* heap_profile_out;   // if set, the profile is dumped here by destroy_ijvm()
+    ijvm_limits limits;
+} ijvm_options;
+
+struct heap_profile;
+
 typedef struct IJVM {
     // do not changes these two variables
     FILE *in;   // use fgetc(ijvm->in) to get a character from in.
@@ -28,21 +190,70 @@ typedef struct IJVM {
     FILE *out;  // use for example fprintf(ijvm->out, "%c", value); to print value to out
 
   // your variables go here
-    byte *text;
+    byte *text;              // points into mapping, or into the arena
     word *constant_pool;
+    void* mapping;           // the binary, mapped read-only, see loader.h
+    size_t mapping_bytes;
     uint32_t constant_pool_size;
     uint32_t text_size;
     unsigned int program_counter;
     int lv_pointer;
     Stack *stack;
     bool halted;
+    ijvm_halt_reason halt_reason; // only set for HALT and budget violations
+    long long instructions_charged;
     
     // --- Heap Management ---
-    heap_object_t** heap; // A dynamic array of pointers to heap objects
-    int heap_size;         // Current number of objects on the heap
-    int heap_capacity;     // Current allocated capacity of the heap array
-    word next_ref;       // Counter to generate unique array references
+    heap_handle_t* heap;   // Handle table, indexed by the slot of a reference
+    int heap_size;         // Number of slots ever handed out
+    int heap_capacity;     // Current allocated capacity of the handle table
+    int free_handle;       // Head of the list of recycled slots, -1 if empty
+    int exhausted_handles; // Free slots that ran out of generations
+    int live_objects;      // Number of slots holding an object
+    size_t heap_bytes;     // Bytes of array data currently allocated
+
+    // Young generation: arrays are bump-allocated here, header and data
+    // contiguous, and promoted to the old space if they survive a collection
+    byte* nursery;
+    size_t nursery_used;
+    heap_object_t** remembered; // Old objects that may point into the nursery
+    int remembered_size;
+    int remembered_capacity;
+    slab_allocator_t slabs;     // Old space
+    arena_t arena;              // Memory released wholesale by destroy_ijvm()
+
+    // --- Garbage Collection ---
+    mark_stack_t mark_stack;    // Grey objects of a stop-the-world collection
+    bool gc_young_only;         // Marking stops at old objects (minor collection)
+    int gc_phase;               // GC_IDLE or GC_MARKING, see gc.h
+    mark_stack_t grey;          // Grey old objects of an incremental cycle
+    mark_stack_t retired;       // Swept objects whose memory is not released yet
+    uint32_t* pause_ns;         // Ring buffer of recent pause times
+    struct heap_profile* profile; // Allocation sites, NULL unless options.heap_profile
+    word* zct;                  // Zero-count table of reference counting mode
+    int zct_size;
+    int zct_capacity;
+    int zct_trigger;            // zct_size at which to reconcile next
+    long long minor_collections;
+    long long full_collections;
+    long long incremental_cycles;
+    long long reconciliations;
+    unsigned long long bytes_allocated; // Array data and map tables ever allocated
+    unsigned long long bytes_freed;
+    size_t old_bytes_since_gc;  // Bytes promoted or allocated old since the last full collection
+    size_t live_after_gc;       // heap_bytes right after the last full collection
+    long long pause_count;      // Pauses recorded so far
+
+    ijvm_options options;
 
 } ijvm;
 
+/**
+ * Checks if the word at the top of the stack is a reference (as opposed to
+ * an integer that happens to have the same value). Declared here rather
+ * than in ijvm_ext.h because the precise garbage collection tests only
+ * include ijvm.h.
+ **/
+bool is_tos_reference(ijvm* m);
+
 #endif 
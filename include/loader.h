@@ -0,0 +1,17 @@
+#ifndef LOADER_H
+#define LOADER_H
+#include <stdbool.h>
+#include "ijvm.h"
+
+// Loads the .ijvm binary at `path` into m->text and m->constant_pool. The
+// file is mapped read-only and the text is used in place, so large
+// binaries start without being read up front and processes running the
+// same binary share its pages. Only the constant pool is copied, to swap
+// it to host byte order. Files that cannot be mapped are read into the
+// arena instead. Returns false if the file is missing or malformed.
+bool load_binary(ijvm* m, const char* path);
+
+// Unmaps what load_binary() mapped.
+void unload_binary(ijvm* m);
+
+#endif
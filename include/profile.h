@@ -0,0 +1,50 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+#include "ijvm.h"
+
+// Opt-in allocation-site heap profiler (options.heap_profile). A site is an
+// allocating instruction together with the chain of methods that led to it.
+// Sites are tracked in side tables indexed by handle slot, so objects carry
+// nothing extra and a VM without a profile pays one NULL check per
+// allocation and per free. Lifetimes are measured in allocations: an
+// object's lifetime is the number of objects allocated while it was alive.
+
+typedef struct {
+    int* frames;              // method addresses, outermost first, main left out
+    int depth;
+    int pc;                   // address of the allocating instruction
+    uint32_t hash;
+    int next;                 // next site in the same bucket, -1 ends
+    long long allocations;
+    long long frees;
+    long long lifetime_total; // summed over freed objects
+    long long live_objects;
+    size_t live_bytes;
+} alloc_site_t;
+
+#define PROFILE_BUCKETS 1024
+
+typedef struct heap_profile {
+    alloc_site_t* sites;
+    int site_count;
+    int site_capacity;
+    int buckets[PROFILE_BUCKETS];
+    int* slot_site;           // site of the object in each handle slot
+    long long* slot_birth;    // allocation clock when it was allocated
+    size_t* slot_bytes;       // bytes it was charged to its site
+    int slot_capacity;
+    long long clock;          // allocations so far
+    int* scratch;             // frame walk buffer
+    int scratch_capacity;
+} heap_profile_t;
+
+heap_profile_t* create_heap_profile(void);
+void destroy_heap_profile(heap_profile_t* profile);
+
+// Charges `obj`, just allocated by the instruction at `pc`, to its site.
+void profile_allocation(ijvm* m, heap_object_t* obj, int pc);
+
+// Credits the death of `obj` to its site. Called as its handle is freed.
+void profile_free(ijvm* m, heap_object_t* obj);
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef REFCOUNT_H
+#define REFCOUNT_H
+#include "ijvm.h"
+
+// Deferred reference counting, the collector of options.reference_counting.
+// Only references held by heap objects are counted: stores into arrays and
+// maps adjust heap_object_t.refcount, while the operand stack (frames and
+// locals included) is not tracked at all. Objects whose count is zero go
+// into the zero-count table instead of being freed, since the stack may
+// still refer to them. Once options.rc_batch_objects entries have piled
+// up, reconcile_counts() scans the stack and frees every listed object it
+// does not find there. Cycles never reach zero; the regular full
+// collection still runs as a backup tracer when the heap keeps growing,
+// and rebuild_counts() recomputes every count afterwards.
+
+// A heap object gained (rc_retain) or lost (rc_release) a reference to
+// whatever `value` refers to. Untagged values are ignored.
+void rc_retain(ijvm* m, word value, uint8_t tag);
+void rc_release(ijvm* m, word value, uint8_t tag);
+
+// rc_retain() or rc_release() for the tagged elements of a word array in
+// [from, from + count). Called after and before elements are overwritten.
+void rc_retain_range(ijvm* m, heap_object_t* obj, int from, int count);
+void rc_release_range(ijvm* m, heap_object_t* obj, int from, int count);
+
+// Lists a new object, which nothing on the heap refers to yet.
+void rc_track(ijvm* m, heap_object_t* obj);
+
+// Frees listed objects that are neither counted nor on the stack, and
+// whatever only they kept alive.
+void reconcile_counts(ijvm* m);
+
+// Recounts every reference from scratch. Called after a full collection,
+// which may have freed objects whose references were still counted.
+void rebuild_counts(ijvm* m);
+
+#endif
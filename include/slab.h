@@ -0,0 +1,40 @@
+#ifndef SLAB_H
+#define SLAB_H
+#include <stddef.h>
+#include "arena.h"
+#include "ijvm_struct.h"
+
+// Size-class allocator for old-space heap objects and the side tables of
+// all objects. Each object is a single block holding the header followed
+// by its elements. Blocks up to SLAB_MAX_BLOCK bytes are carved out of
+// arena regions and recycled through per-class free lists; larger blocks
+// go to malloc and are counted in `outside`.
+// Blocks of LARGE_OBJECT_BYTES and up are anonymous mappings: their pages
+// are zero and only backed by memory once touched, and freeing one hands
+// it straight back to the OS.
+#define SLAB_CHUNK_BYTES ARENA_REGION_BYTES
+#define SLAB_MAX_BLOCK 4096
+#define LARGE_OBJECT_BYTES (256 * 1024)
+
+void init_slabs(slab_allocator_t* slabs, arena_t* arena);
+
+// Returns an uninitialised block of at least `bytes` bytes, or NULL when
+// no memory is left.
+void* slab_alloc(slab_allocator_t* slabs, size_t bytes);
+
+// Like slab_alloc(), but the block is zero-filled.
+void* slab_calloc(slab_allocator_t* slabs, size_t bytes);
+
+// Bytes of chunk space a block of `bytes` bytes takes up, or 0 if it is
+// allocated outside the chunks.
+size_t slab_block_bytes(size_t bytes);
+
+// Returns a block to its size class. `bytes` must be the size it was
+// allocated with.
+void slab_free(slab_allocator_t* slabs, void* block, size_t bytes);
+
+// Gives every chunk back to the arena. Blocks larger than SLAB_MAX_BLOCK
+// are not tracked and have to be freed by the caller.
+void destroy_slabs(slab_allocator_t* slabs);
+
+#endif
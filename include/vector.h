@@ -0,0 +1,18 @@
+#ifndef VECTOR_H
+#define VECTOR_H
+#include "ijvm_ext.h"
+
+// Kernels behind OP_VECOP and OP_VECREDUCE. Each has a portable scalar
+// version and, on x86-64, SSE2 and AVX2 versions; the widest one the CPU
+// supports is picked on first use. All of them compute exactly what the
+// scalar loop does, wrapping around on overflow like IADD and ISUB.
+
+// dst[i] = a[i] op b[i] for i < n, op one of the VEC_ operations. dst may
+// be a or b.
+void vector_binary(int op, word* dst, const word* a, const word* b, int n);
+
+// Sum, minimum or maximum of a[0..n). An empty range gives 0, INT32_MAX or
+// INT32_MIN.
+word vector_reduce(int op, const word* a, int n);
+
+#endif
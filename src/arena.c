@@ -0,0 +1,201 @@
+#define _POSIX_C_SOURCE 200809L
+#include <pthread.h>
+#include <stdlib.h>
+#include "arena.h"
+#include "ijvm_ext.h"
+
+#define ARENA_ALIGN 16
+
+// Blocks nobody owns right now, shared by every VM in the process. Pooled
+// regions are linked through `next` only.
+static struct {
+    pthread_mutex_t lock;
+    arena_block_t* regions;
+    int region_count;
+    arena_block_t* large;
+    size_t large_bytes;
+} pool = { PTHREAD_MUTEX_INITIALIZER, NULL, 0, NULL, 0 };
+
+static void* block_data(arena_block_t* block) {
+    return block + 1;
+}
+
+void init_arena(arena_t* arena) {
+    arena->regions = NULL;
+    arena->last_region = NULL;
+    arena->region_count = 0;
+    arena->large = NULL;
+    arena->bump = NULL;
+    arena->bump_end = NULL;
+}
+
+static arena_block_t* take_region(arena_t* arena) {
+    pthread_mutex_lock(&pool.lock);
+    arena_block_t* block = pool.regions;
+    if (block) {
+        pool.regions = block->next;
+        pool.region_count--;
+    }
+    pthread_mutex_unlock(&pool.lock);
+    if (block == NULL) {
+        block = malloc(sizeof(arena_block_t) + ARENA_REGION_BYTES);
+        if (block == NULL) return NULL;
+        block->bytes = ARENA_REGION_BYTES;
+    }
+
+    block->prev = NULL;
+    block->next = arena->regions;
+    if (arena->regions) arena->regions->prev = block;
+    else arena->last_region = block;
+    arena->regions = block;
+    arena->region_count++;
+    return block;
+}
+
+// Reuses a pooled block of at least `bytes` bytes that does not waste more
+// than half of itself, or allocates a new one.
+static void* alloc_large(arena_t* arena, size_t bytes) {
+    arena_block_t* block = NULL;
+    pthread_mutex_lock(&pool.lock);
+    for (arena_block_t** link = &pool.large; *link; link = &(*link)->next) {
+        if ((*link)->bytes >= bytes && (*link)->bytes / 2 <= bytes) {
+            block = *link;
+            *link = block->next;
+            pool.large_bytes -= block->bytes;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&pool.lock);
+    if (block == NULL) {
+        block = malloc(sizeof(arena_block_t) + bytes);
+        if (block == NULL) return NULL;
+        block->bytes = bytes;
+    }
+    block->next = arena->large;
+    arena->large = block;
+    return block_data(block);
+}
+
+void* arena_alloc(arena_t* arena, size_t bytes) {
+    bytes = bytes == 0 ? ARENA_ALIGN : (bytes + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    if (bytes > ARENA_LARGE_BYTES) return alloc_large(arena, bytes);
+    if (arena->bump == NULL && arena->regions == NULL) {
+        // A VM that never touches its heap only needs a few hundred bytes
+        // for the constant pool, so it does not get a whole region
+        size_t first = bytes > ARENA_FIRST_BYTES ? bytes : ARENA_FIRST_BYTES;
+        byte* block = alloc_large(arena, first);
+        if (block == NULL) return NULL;
+        arena->bump = block + bytes;
+        arena->bump_end = block + first;
+        return block;
+    }
+    if (arena->bump == NULL || arena->bump + bytes > arena->bump_end) {
+        arena_block_t* block = take_region(arena);
+        if (block == NULL) return NULL;
+        arena->bump = block_data(block);
+        arena->bump_end = arena->bump + ARENA_REGION_BYTES;
+    }
+    void* p = arena->bump;
+    arena->bump += bytes;
+    return p;
+}
+
+void* arena_region(arena_t* arena) {
+    arena_block_t* block = take_region(arena);
+    return block ? block_data(block) : NULL;
+}
+
+void arena_free_region(arena_t* arena, void* region) {
+    arena_block_t* block = (arena_block_t*)region - 1;
+    if (block->prev) block->prev->next = block->next;
+    else arena->regions = block->next;
+    if (block->next) block->next->prev = block->prev;
+    else arena->last_region = block->prev;
+    arena->region_count--;
+
+    pthread_mutex_lock(&pool.lock);
+    if (pool.region_count < ARENA_POOL_REGIONS) {
+        block->next = pool.regions;
+        pool.regions = block;
+        pool.region_count++;
+        block = NULL;
+    }
+    pthread_mutex_unlock(&pool.lock);
+    free(block);
+}
+
+void release_arena(arena_t* arena) {
+    arena_block_t* spill = NULL;
+    arena_block_t* large = arena->large;
+    pthread_mutex_lock(&pool.lock);
+    // The common case splices the whole region list in one go
+    if (pool.region_count + arena->region_count <= ARENA_POOL_REGIONS) {
+        if (arena->regions) {
+            arena->last_region->next = pool.regions;
+            pool.regions = arena->regions;
+            pool.region_count += arena->region_count;
+        }
+    } else {
+        arena_block_t* block = arena->regions;
+        while (block && pool.region_count < ARENA_POOL_REGIONS) {
+            arena_block_t* next = block->next;
+            block->next = pool.regions;
+            pool.regions = block;
+            pool.region_count++;
+            block = next;
+        }
+        spill = block;
+    }
+    // Blocks that are too big, or do not fit in the pool any more, are
+    // collected on `unpooled` and freed below
+    arena_block_t* unpooled = NULL;
+    while (large) {
+        arena_block_t* next = large->next;
+        if (large->bytes <= ARENA_POOL_MAX_LARGE
+            && pool.large_bytes + large->bytes <= ARENA_POOL_LARGE_BYTES) {
+            large->next = pool.large;
+            pool.large = large;
+            pool.large_bytes += large->bytes;
+        } else {
+            large->next = unpooled;
+            unpooled = large;
+        }
+        large = next;
+    }
+    large = unpooled;
+    pthread_mutex_unlock(&pool.lock);
+
+    while (spill) {
+        arena_block_t* next = spill->next;
+        free(spill);
+        spill = next;
+    }
+    while (large) {
+        arena_block_t* next = large->next;
+        free(large);
+        large = next;
+    }
+    init_arena(arena);
+}
+
+void trim_arena_pool(void) {
+    pthread_mutex_lock(&pool.lock);
+    arena_block_t* regions = pool.regions;
+    arena_block_t* large = pool.large;
+    pool.regions = NULL;
+    pool.region_count = 0;
+    pool.large = NULL;
+    pool.large_bytes = 0;
+    pthread_mutex_unlock(&pool.lock);
+
+    while (regions) {
+        arena_block_t* next = regions->next;
+        free(regions);
+        regions = next;
+    }
+    while (large) {
+        arena_block_t* next = large->next;
+        free(large);
+        large = next;
+    }
+}
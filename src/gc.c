@@ -0,0 +1,455 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "arena.h"
+#include "gc.h"
+#include "gc_parallel.h"
+#include "hashmap.h"
+#include "heap.h"
+#include "ijvm_ext.h"
+#include "refcount.h"
+#include "slab.h"
+
+// Automatic compaction is not worth it for a heap this small
+#define COMPACT_MIN_CHUNKS 4
+
+void mark_push(mark_stack_t* stack, heap_object_t* obj) {
+    if (stack->size >= stack->capacity) {
+        stack->capacity = stack->capacity == 0 ? 64 : stack->capacity * 2;
+        stack->items = realloc(stack->items, stack->capacity * sizeof(heap_object_t*));
+    }
+    stack->items[stack->size++] = obj;
+}
+
+static long long now_ns(void) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void record_pause(ijvm* m, long long start_ns) {
+    long long elapsed = now_ns() - start_ns;
+    if (m->pause_ns == NULL) {
+        m->pause_ns = arena_alloc(&m->arena, GC_PAUSE_SAMPLES * sizeof(uint32_t));
+        // Without a ring the pause is simply not recorded
+        if (m->pause_ns == NULL) return;
+    }
+    if (elapsed > UINT32_MAX) elapsed = UINT32_MAX;
+    m->pause_ns[m->pause_count % GC_PAUSE_SAMPLES] = (uint32_t)elapsed;
+    m->pause_count++;
+}
+
+static void notify_collection(ijvm* m) {
+    if (m->options.heap_stats_hook == NULL) return;
+    heap_stats stats;
+    get_heap_stats(m, &stats);
+    m->options.heap_stats_hook(m, &stats, m->options.heap_stats_hook_data);
+}
+
+// Marks the object `value` refers to, if any, and queues it for scanning.
+// During a minor collection old objects are neither marked nor traced.
+static void mark_word(ijvm* m, word value, void* data) {
+    (void)data;
+    heap_object_t* obj = find_heap_object(m, value);
+    if (obj == NULL || obj->marked) return;
+    if (m->gc_young_only && obj->space != SPACE_NURSERY) return;
+    obj->marked = true;
+    mark_push(&m->mark_stack, obj);
+}
+
+// Incremental counterpart of mark_word(). Nursery objects are left alone:
+// the ones that survive are greyed when they get promoted.
+static void shade(ijvm* m, word value, void* data) {
+    (void)data;
+    heap_object_t* obj = find_heap_object(m, value);
+    if (obj == NULL || obj->marked || obj->space == SPACE_NURSERY) return;
+    obj->marked = true;
+    mark_push(&m->grey, obj);
+}
+
+void scan_roots(ijvm* m, mark_fn mark, void* data) {
+    Stack* s = m->stack;
+    for (int i = 0; i <= s->top; i++) {
+        if (m->options.precise_gc && !s->tags[i]) continue;
+        mark(m, s->elements[i], data);
+    }
+}
+
+static void scan_map(ijvm* m, hash_map_t* map, mark_fn mark, void* data) {
+    bool precise = m->options.precise_gc;
+    for (int i = 0; i < map->capacity; i++) {
+        map_entry_t* e = &map->entries[i];
+        if (e->state != MAP_FULL) continue;
+        if (!precise || e->key_tag) mark(m, e->key, data);
+        if (!precise || e->value_tag) mark(m, e->value, data);
+    }
+}
+
+void scan_object(ijvm* m, heap_object_t* obj, mark_fn mark, void* data) {
+    if (obj->type == TYPE_MAP) {
+        scan_map(m, map_of(obj), mark, data);
+        return;
+    }
+    // Other than maps, only word arrays can hold references
+    if (obj->type != ATYPE_INT) return;
+    if (m->options.precise_gc) {
+        if (obj->tags == NULL) return;
+        for (int i = 0; i < obj->size; i++) {
+            if (obj->tags[i]) mark(m, obj->data[i], data);
+        }
+        return;
+    }
+    for (int i = 0; i < obj->size; i++) {
+        mark(m, obj->data[i], data);
+    }
+}
+
+static void drain_mark_stack(ijvm* m) {
+    while (m->mark_stack.size > 0) {
+        scan_object(m, m->mark_stack.items[--m->mark_stack.size], mark_word, NULL);
+    }
+}
+
+static void clear_remembered(ijvm* m) {
+    for (int i = 0; i < m->remembered_size; i++) {
+        m->remembered[i]->remembered = false;
+    }
+    m->remembered_size = 0;
+}
+
+// Retires unmarked old objects, leaving their memory to be released by
+// later allocations. Nursery objects are left to evacuate_nursery.
+static void sweep(ijvm* m) {
+    // Whatever the previous sweep left behind goes first, so retired
+    // memory never outlives the next cycle
+    release_retired(m, -1);
+    for (int i = 0; i < m->heap_size; i++) {
+        heap_object_t* obj = m->heap[i].object;
+        if (obj == NULL || obj->space == SPACE_NURSERY) continue;
+        if (obj->marked) obj->marked = false;
+        else retire_heap_object(m, obj);
+    }
+}
+
+// Promotes every marked nursery object to the old space, frees the others
+// and empties the nursery. Nothing young survives, so the remembered set is
+// no longer needed afterwards. Objects promoted while an incremental cycle
+// is running still have to be traced by it, so they are greyed.
+static void evacuate_nursery(ijvm* m) {
+    size_t offset = 0;
+    while (offset < m->nursery_used) {
+        heap_object_t* obj = (heap_object_t*)(m->nursery + offset);
+        offset += nursery_footprint(obj->type, obj->size);
+        if (!obj->marked) {
+            free_heap_object(m, obj);
+            continue;
+        }
+        heap_object_t* old = promote_object(m, obj);
+        if (old == NULL) {
+            // Out of memory. The nursery is emptied all the same, so the
+            // object goes and the machine stops.
+            free_heap_object(m, obj);
+            m->halted = true;
+            continue;
+        }
+        if (m->gc_phase == GC_MARKING) {
+            old->marked = true;
+            mark_push(&m->grey, old);
+        }
+    }
+    m->nursery_used = 0;
+    clear_remembered(m);
+}
+
+static void young_collection(ijvm* m) {
+    m->gc_young_only = true;
+    scan_roots(m, mark_word, NULL);
+    for (int i = 0; i < m->remembered_size; i++) {
+        scan_object(m, m->remembered[i], mark_word, NULL);
+    }
+    drain_mark_stack(m);
+    m->gc_young_only = false;
+    evacuate_nursery(m);
+}
+
+void collect_young(ijvm* m) {
+    if (m->nursery_used == 0) return;
+    long long start = now_ns();
+    young_collection(m);
+    release_retired(m, LAZY_FREE_BATCH);
+    m->minor_collections++;
+    record_pause(m, start);
+    notify_collection(m);
+}
+
+// Drops an unfinished incremental cycle, whitening everything it marked.
+static void abandon_incremental_gc(ijvm* m) {
+    m->grey.size = 0;
+    for (int i = 0; i < m->heap_size; i++) {
+        if (m->heap[i].object) m->heap[i].object->marked = false;
+    }
+    m->gc_phase = GC_IDLE;
+}
+
+// Returns a copy of a chunk block in `to`, or NULL if `to` ran out of
+// memory. Blocks outside the chunks stay where they are.
+static void* move_block(slab_allocator_t* to, void* block, size_t bytes) {
+    if (block == NULL || bytes > SLAB_MAX_BLOCK) return block;
+    void* copy = slab_alloc(to, bytes);
+    if (copy) memcpy(copy, block, bytes);
+    return copy;
+}
+
+// New locations of an object and its side tables during compaction.
+typedef struct {
+    heap_object_t* object;
+    uint8_t* tags;
+    map_entry_t* entries;
+} moved_object_t;
+
+// Copies live slab objects and side tables into a new allocator, in handle
+// order, so they end up packed together in as few chunks as possible. Only
+// valid right after a full collection: the nursery, remembered set and
+// grey list must not hold object pointers. Handles are only repointed once
+// every copy has succeeded, so running out of memory leaves the old space
+// as it was.
+static void compact_old_space(ijvm* m) {
+    release_retired(m, -1);
+    moved_object_t* moved = malloc((size_t)m->heap_size * sizeof(moved_object_t));
+    if (moved == NULL) return;
+    slab_allocator_t fresh;
+    init_slabs(&fresh, &m->arena);
+    fresh.outside = m->slabs.outside;
+    bool copied = true;
+    for (int i = 0; copied && i < m->heap_size; i++) {
+        heap_object_t* obj = m->heap[i].object;
+        if (obj == NULL) continue;
+        moved_object_t* to = &moved[i];
+        to->tags = move_block(&fresh, obj->tags, (size_t)obj->size);
+        to->entries = obj->type == TYPE_MAP
+            ? move_block(&fresh, map_of(obj)->entries, map_table_bytes(obj)) : NULL;
+        size_t bytes = object_bytes(obj->type, obj->size);
+        to->object = bytes > SLAB_MAX_BLOCK ? obj : move_block(&fresh, obj, bytes);
+        copied = to->object != NULL && (obj->tags == NULL || to->tags != NULL)
+            && (obj->type != TYPE_MAP || map_of(obj)->entries == NULL || to->entries != NULL);
+    }
+    if (!copied) {
+        destroy_slabs(&fresh);
+        free(moved);
+        return;
+    }
+    for (int i = 0; i < m->heap_size; i++) {
+        if (m->heap[i].object == NULL) continue;
+        heap_object_t* copy = moved[i].object;
+        copy->data = (word*)(copy + 1);
+        copy->tags = moved[i].tags;
+        if (copy->type == TYPE_MAP) map_of(copy)->entries = moved[i].entries;
+        m->heap[i].object = copy;
+    }
+    destroy_slabs(&m->slabs);
+    m->slabs = fresh;
+    free(moved);
+}
+
+static bool too_fragmented(ijvm* m) {
+    if (m->options.compact_percent <= 0) return false;
+    if (m->slabs.committed < COMPACT_MIN_CHUNKS * SLAB_CHUNK_BYTES) return false;
+    // Retired blocks still count as used until they are released
+    size_t unused = m->slabs.committed - m->slabs.used;
+    for (int i = 0; i < m->retired.size; i++) {
+        heap_object_t* obj = m->retired.items[i];
+        unused += slab_block_bytes(object_bytes(obj->type, obj->size));
+        if (obj->tags) unused += slab_block_bytes((size_t)obj->size);
+        if (obj->type == TYPE_MAP) unused += slab_block_bytes(map_table_bytes(obj));
+    }
+    return unused * 100 >= m->slabs.committed * (size_t)m->options.compact_percent;
+}
+
+// Restarts the growth budget once a full collection has finished.
+static void reset_growth(ijvm* m) {
+    m->old_bytes_since_gc = 0;
+    m->live_after_gc = m->heap_bytes;
+}
+
+static void full_collection(ijvm* m) {
+    if (m->gc_phase == GC_MARKING) abandon_incremental_gc(m);
+    int threads = m->options.gc_threads;
+    bool parallel = threads > 1 && m->heap_size >= PARALLEL_GC_MIN_HANDLES;
+    if (!parallel || !parallel_mark(m, threads)) {
+        scan_roots(m, mark_word, NULL);
+        drain_mark_stack(m);
+    }
+    // Old objects may be freed below, so drop the remembered set first
+    clear_remembered(m);
+    if (!parallel || !parallel_sweep(m, threads)) sweep(m);
+    evacuate_nursery(m);
+    rebuild_counts(m);
+    reset_growth(m);
+}
+
+void collect_garbage(ijvm* m) {
+    if (m->live_objects == 0) {
+        // Nothing to mark, but what the last sweep retired can go now
+        release_retired(m, -1);
+        return;
+    }
+    long long start = now_ns();
+    full_collection(m);
+    if (too_fragmented(m)) compact_old_space(m);
+    m->full_collections++;
+    record_pause(m, start);
+    notify_collection(m);
+}
+
+// Live slab objects are moved into fresh chunks and handles are repointed,
+// so references stay valid. Large objects are not moved.
+void compact_heap(ijvm* m) {
+    long long start = now_ns();
+    full_collection(m);
+    compact_old_space(m);
+    m->full_collections++;
+    record_pause(m, start);
+    notify_collection(m);
+}
+
+void start_incremental_gc(ijvm* m) {
+    if (m->gc_phase != GC_IDLE) return;
+    long long start = now_ns();
+    m->gc_phase = GC_MARKING;
+    scan_roots(m, shade, NULL);
+    record_pause(m, start);
+}
+
+// Final pause of a cycle. The stack is not covered by the write barrier, so
+// it is rescanned; survivors of the nursery are promoted (and greyed) so
+// that anything only they refer to is traced too.
+static void finish_incremental_gc(ijvm* m) {
+    if (m->nursery_used > 0) young_collection(m);
+    scan_roots(m, shade, NULL);
+    while (m->grey.size > 0) {
+        scan_object(m, m->grey.items[--m->grey.size], shade, NULL);
+    }
+    sweep(m);
+    m->gc_phase = GC_IDLE;
+    reset_growth(m);
+}
+
+void gc_slice(ijvm* m) {
+    if (m->gc_phase != GC_MARKING) return;
+    long long start = now_ns();
+    long long deadline = m->options.gc_slice_micros > 0
+        ? start + (long long)m->options.gc_slice_micros * 1000 : 0;
+    for (int done = 0; m->grey.size > 0 && done < m->options.gc_slice_objects; done++) {
+        scan_object(m, m->grey.items[--m->grey.size], shade, NULL);
+        // Reading the clock is not free, so only check it now and then
+        if (deadline && (done & 31) == 31 && now_ns() >= deadline) break;
+    }
+    bool finished = m->grey.size == 0;
+    if (finished) {
+        finish_incremental_gc(m);
+        m->incremental_cycles++;
+    }
+    record_pause(m, start);
+    if (finished) notify_collection(m);
+}
+
+static size_t growth_threshold(ijvm* m) {
+    size_t threshold = (size_t)((double)m->live_after_gc * m->options.gc_growth_factor);
+    return threshold < m->options.gc_min_trigger_bytes
+        ? m->options.gc_min_trigger_bytes : threshold;
+}
+
+void request_collection(ijvm* m, gc_trigger trigger) {
+    if (m->options.gc_hook) {
+        gc_decision decision;
+        decision.trigger = trigger;
+        decision.allocated_since_gc = m->old_bytes_since_gc;
+        decision.live_after_gc = m->live_after_gc;
+        decision.threshold = growth_threshold(m);
+        decision.heap_bytes = m->heap_bytes;
+        m->options.gc_hook(m, &decision, m->options.gc_hook_data);
+    }
+    // Hitting a limit needs memory back now, which only a full collection
+    // can guarantee
+    bool at_limit = trigger == GC_TRIGGER_HEAP_CAP || trigger == GC_TRIGGER_ARRAY_CAP;
+    if (m->options.incremental_gc && !at_limit) start_incremental_gc(m);
+    else collect_garbage(m);
+}
+
+bool heap_limit_allows(ijvm* m, size_t bytes) {
+    size_t max = m->options.limits.max_heap_bytes;
+    // Never subtract past zero, even if heap_bytes is over the limit
+    return max == 0 || (m->heap_bytes <= max && bytes <= max - m->heap_bytes);
+}
+
+void collect_if_needed(ijvm* m, size_t bytes) {
+    ijvm_limits* limits = &m->options.limits;
+    if (!heap_limit_allows(m, bytes)) {
+        request_collection(m, GC_TRIGGER_HEAP_CAP);
+    } else if (limits->max_live_arrays > 0 && m->live_objects >= limits->max_live_arrays) {
+        request_collection(m, GC_TRIGGER_ARRAY_CAP);
+    } else if (m->gc_phase == GC_IDLE && m->old_bytes_since_gc > 0
+               && m->old_bytes_since_gc >= growth_threshold(m)) {
+        request_collection(m, GC_TRIGGER_GROWTH);
+    }
+}
+
+void shade_reference(ijvm* m, word value, uint8_t tag) {
+    if (m->options.precise_gc && !tag) return;
+    shade(m, value, NULL);
+}
+
+void destroy_gc(ijvm* m) {
+    free(m->mark_stack.items);
+    free(m->grey.items);
+    free(m->zct);
+    m->zct = NULL;
+    m->zct_size = 0;
+    m->zct_capacity = 0;
+    memset(&m->mark_stack, 0, sizeof(m->mark_stack));
+    memset(&m->grey, 0, sizeof(m->grey));
+    m->pause_ns = NULL;
+}
+
+static int compare_u32(const void* a, const void* b) {
+    uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+    return (x > y) - (x < y);
+}
+
+void get_gc_pause_stats(ijvm* m, gc_pause_stats* stats) {
+    memset(stats, 0, sizeof(*stats));
+    stats->count = m->pause_count;
+    if (m->pause_count == 0) return;
+
+    int n = m->pause_count < GC_PAUSE_SAMPLES ? (int)m->pause_count : GC_PAUSE_SAMPLES;
+    uint32_t* sorted = malloc(n * sizeof(uint32_t));
+    memcpy(sorted, m->pause_ns, n * sizeof(uint32_t));
+    qsort(sorted, n, sizeof(uint32_t), compare_u32);
+    // nearest-rank percentiles
+    stats->p50_ns = sorted[(n * 50 + 99) / 100 - 1];
+    stats->p99_ns = sorted[(n * 99 + 99) / 100 - 1];
+    stats->max_ns = sorted[n - 1];
+    free(sorted);
+}
+
+void get_heap_stats(ijvm* m, heap_stats* stats) {
+    gc_pause_stats pauses;
+    get_gc_pause_stats(m, &pauses);
+    memset(stats, 0, sizeof(*stats));
+    stats->minor_collections = m->minor_collections;
+    stats->full_collections = m->full_collections;
+    stats->incremental_cycles = m->incremental_cycles;
+    stats->reconciliations = m->reconciliations;
+    stats->pauses = pauses.count;
+    stats->pause_p50_ns = pauses.p50_ns;
+    stats->pause_p99_ns = pauses.p99_ns;
+    stats->pause_max_ns = pauses.max_ns;
+    stats->bytes_allocated = m->bytes_allocated;
+    stats->bytes_freed = m->bytes_freed;
+    stats->live_objects = m->live_objects;
+    stats->live_bytes = m->heap_bytes;
+    stats->heap_size = m->heap_size;
+    stats->heap_capacity = m->heap_capacity;
+    stats->slab_committed_bytes = m->slabs.committed;
+    stats->nursery_bytes = m->nursery ? m->options.nursery_bytes : 0;
+}
@@ -0,0 +1,276 @@
+#define _POSIX_C_SOURCE 200809L
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include "gc.h"
+#include "gc_parallel.h"
+#include "heap.h"
+
+// A worker offers half of its mark stack to the others once it holds more
+// than this many objects and its previous offer has been taken.
+#define SHARE_THRESHOLD 64
+
+typedef struct {
+    mark_stack_t local;     // Only touched by the owner
+    mark_stack_t shared;    // Up for stealing, guarded by lock
+    int shared_size;        // shared.size, readable without the lock
+    pthread_mutex_t lock;
+} mark_worker_t;
+
+typedef struct {
+    ijvm* m;
+    mark_worker_t* workers;
+    int count;
+    int idle;               // Workers that found nothing to do
+    int failed;             // Set once a mark stack could not grow
+} mark_pool_t;
+
+typedef struct {
+    mark_pool_t* pool;
+    int id;
+} mark_arg_t;
+
+// mark_push() that leaves the stack as it was if it cannot grow.
+static bool try_push(mark_stack_t* stack, heap_object_t* obj) {
+    if (stack->size >= stack->capacity) {
+        int capacity = stack->capacity == 0 ? 64 : stack->capacity * 2;
+        heap_object_t** items = realloc(stack->items, (size_t)capacity * sizeof(heap_object_t*));
+        if (items == NULL) return false;
+        stack->items = items;
+        stack->capacity = capacity;
+    }
+    stack->items[stack->size++] = obj;
+    return true;
+}
+
+static void fail(mark_pool_t* pool) {
+    __atomic_store_n(&pool->failed, 1, __ATOMIC_SEQ_CST);
+}
+
+static bool failed(mark_pool_t* pool) {
+    return __atomic_load_n(&pool->failed, __ATOMIC_SEQ_CST) != 0;
+}
+
+static void mark_atomic(ijvm* m, word value, void* data) {
+    mark_arg_t* a = data;
+    heap_object_t* obj = find_heap_object(m, value);
+    if (obj == NULL || __atomic_load_n(&obj->marked, __ATOMIC_RELAXED)) return;
+    if (__atomic_exchange_n(&obj->marked, true, __ATOMIC_RELAXED)) return;
+    if (!try_push(&a->pool->workers[a->id].local, obj)) fail(a->pool);
+}
+
+// Moves the bottom half of the local stack, the objects pushed first, to
+// the shared stack. Whatever does not fit there stays local.
+static void share(mark_worker_t* self) {
+    int half = self->local.size / 2;
+    int moved = 0;
+    pthread_mutex_lock(&self->lock);
+    while (moved < half && try_push(&self->shared, self->local.items[moved])) moved++;
+    __atomic_store_n(&self->shared_size, self->shared.size, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&self->lock);
+    self->local.size -= moved;
+    memmove(self->local.items, self->local.items + moved,
+            (size_t)self->local.size * sizeof(heap_object_t*));
+}
+
+// Takes half (at least one) of the victim's shared objects.
+static bool steal(mark_pool_t* pool, mark_worker_t* self, mark_worker_t* victim) {
+    pthread_mutex_lock(&victim->lock);
+    int take = (victim->shared.size + 1) / 2;
+    int taken = 0;
+    while (taken < take) {
+        if (!try_push(&self->local, victim->shared.items[victim->shared.size - 1])) {
+            fail(pool);
+            break;
+        }
+        victim->shared.size--;
+        taken++;
+    }
+    __atomic_store_n(&victim->shared_size, victim->shared.size, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&victim->lock);
+    return taken > 0;
+}
+
+static bool any_shared(mark_pool_t* pool) {
+    for (int i = 0; i < pool->count; i++) {
+        if (__atomic_load_n(&pool->workers[i].shared_size, __ATOMIC_SEQ_CST) > 0) return true;
+    }
+    return false;
+}
+
+static bool find_work(mark_pool_t* pool, int id) {
+    mark_worker_t* self = &pool->workers[id];
+    for (int k = 0; k < pool->count; k++) {
+        mark_worker_t* victim = &pool->workers[(id + k) % pool->count];
+        if (__atomic_load_n(&victim->shared_size, __ATOMIC_SEQ_CST) > 0
+            && steal(pool, self, victim)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Traces until every worker is idle at once. A worker only goes idle after
+// finding every shared stack empty, and idle workers hold no objects, so
+// once all of them are idle no work is left anywhere. After a failed push
+// every worker gives up, as the marks are redone serially anyway.
+static void run_worker(mark_pool_t* pool, int id) {
+    mark_worker_t* self = &pool->workers[id];
+    mark_arg_t arg = { pool, id };
+    for (;;) {
+        while (self->local.size > 0) {
+            if (failed(pool)) return;
+            scan_object(pool->m, self->local.items[--self->local.size], mark_atomic, &arg);
+            if (self->local.size > SHARE_THRESHOLD
+                && __atomic_load_n(&self->shared_size, __ATOMIC_SEQ_CST) == 0) {
+                share(self);
+            }
+        }
+        if (find_work(pool, id)) continue;
+
+        __atomic_add_fetch(&pool->idle, 1, __ATOMIC_SEQ_CST);
+        for (;;) {
+            if (failed(pool)) return;
+            if (__atomic_load_n(&pool->idle, __ATOMIC_SEQ_CST) == pool->count) return;
+            if (any_shared(pool)) {
+                __atomic_sub_fetch(&pool->idle, 1, __ATOMIC_SEQ_CST);
+                break;
+            }
+            sched_yield();
+        }
+    }
+}
+
+static void* mark_thread(void* arg) {
+    mark_arg_t* a = arg;
+    run_worker(a->pool, a->id);
+    return NULL;
+}
+
+static int clamp_threads(int threads) {
+    if (threads < 1) return 1;
+    return threads > PARALLEL_GC_MAX_THREADS ? PARALLEL_GC_MAX_THREADS : threads;
+}
+
+bool parallel_mark(ijvm* m, int threads) {
+    threads = clamp_threads(threads);
+    mark_worker_t* workers = calloc((size_t)threads, sizeof(mark_worker_t));
+    mark_arg_t* args = malloc((size_t)threads * sizeof(mark_arg_t));
+    pthread_t* ids = malloc((size_t)threads * sizeof(pthread_t));
+    if (workers == NULL || args == NULL || ids == NULL) {
+        free(workers);
+        free(args);
+        free(ids);
+        return false;
+    }
+    for (int i = 0; i < threads; i++) {
+        pthread_mutex_init(&workers[i].lock, NULL);
+    }
+
+    // Mark the roots here and deal them out, so every worker starts busy
+    mark_pool_t pool = { m, workers, threads, 0, 0 };
+    args[0].pool = &pool;
+    args[0].id = 0;
+    scan_roots(m, mark_atomic, &args[0]);
+    for (int i = 0; i < workers[0].local.size && !failed(&pool); i++) {
+        if (!try_push(&workers[i % threads].shared, workers[0].local.items[i])) fail(&pool);
+    }
+    workers[0].local.size = 0;
+    for (int i = 0; i < threads; i++) {
+        workers[i].shared_size = workers[i].shared.size;
+    }
+
+    // A worker whose thread fails to start counts as idle from the outset;
+    // the others steal the roots it was dealt
+    int started = 1;
+    for (int i = 1; i < threads && !failed(&pool); i++) {
+        args[i].pool = &pool;
+        args[i].id = i;
+        if (pthread_create(&ids[i], NULL, mark_thread, &args[i]) == 0) {
+            ids[started++] = ids[i];
+        } else {
+            __atomic_add_fetch(&pool.idle, 1, __ATOMIC_SEQ_CST);
+        }
+    }
+    if (!failed(&pool)) run_worker(&pool, 0);
+    for (int i = 1; i < started; i++) {
+        pthread_join(ids[i], NULL);
+    }
+
+    for (int i = 0; i < threads; i++) {
+        pthread_mutex_destroy(&workers[i].lock);
+        free(workers[i].local.items);
+        free(workers[i].shared.items);
+    }
+    free(workers);
+    free(args);
+    free(ids);
+
+    // Some marked objects were never scanned; start over from clean marks
+    if (!failed(&pool)) return true;
+    for (int i = 0; i < m->heap_size; i++) {
+        if (m->heap[i].object) m->heap[i].object->marked = false;
+    }
+    return false;
+}
+
+typedef struct {
+    ijvm* m;
+    int begin, end;
+    mark_stack_t dead;
+} sweep_range_t;
+
+static void* sweep_range(void* arg) {
+    sweep_range_t* r = arg;
+    for (int i = r->begin; i < r->end; i++) {
+        heap_object_t* obj = r->m->heap[i].object;
+        if (obj == NULL || obj->space == SPACE_NURSERY) continue;
+        if (obj->marked) obj->marked = false;
+        // One that does not fit on the list stays unmarked and is found
+        // again by the next collection
+        else try_push(&r->dead, obj);
+    }
+    return NULL;
+}
+
+bool parallel_sweep(ijvm* m, int threads) {
+    threads = clamp_threads(threads);
+    sweep_range_t* ranges = calloc((size_t)threads, sizeof(sweep_range_t));
+    pthread_t* ids = malloc((size_t)threads * sizeof(pthread_t));
+    bool* started = calloc((size_t)threads, sizeof(bool));
+    if (ranges == NULL || ids == NULL || started == NULL) {
+        free(ranges);
+        free(ids);
+        free(started);
+        return false;
+    }
+    release_retired(m, -1);
+    int per_thread = (m->heap_size + threads - 1) / threads;
+    for (int i = 0; i < threads; i++) {
+        ranges[i].m = m;
+        ranges[i].begin = i * per_thread < m->heap_size ? i * per_thread : m->heap_size;
+        ranges[i].end = ranges[i].begin + per_thread < m->heap_size
+            ? ranges[i].begin + per_thread : m->heap_size;
+    }
+    for (int i = 1; i < threads; i++) {
+        started[i] = pthread_create(&ids[i], NULL, sweep_range, &ranges[i]) == 0;
+    }
+    sweep_range(&ranges[0]);
+    for (int i = 1; i < threads; i++) {
+        if (started[i]) pthread_join(ids[i], NULL);
+        else sweep_range(&ranges[i]);
+    }
+
+    // Retiring touches the free list, so it stays serial
+    for (int i = 0; i < threads; i++) {
+        for (int j = 0; j < ranges[i].dead.size; j++) {
+            retire_heap_object(m, ranges[i].dead.items[j]);
+        }
+        free(ranges[i].dead.items);
+    }
+    free(ranges);
+    free(ids);
+    free(started);
+    return true;
+}
@@ -0,0 +1,147 @@
+#include <stdlib.h>
+#include "hashmap.h"
+#include "heap.h"
+#include "refcount.h"
+#include "slab.h"
+
+#define MAP_INITIAL_CAPACITY 8
+
+// murmur3's finalizer, so that sequential keys spread over the table
+static uint32_t hash_key(word key) {
+    uint32_t h = (uint32_t)key;
+    h ^= h >> 16;
+    h *= 0x85EBCA6B;
+    h ^= h >> 13;
+    h *= 0xC2B2AE35;
+    h ^= h >> 16;
+    return h;
+}
+
+// Returns the entry holding `key`, or NULL.
+static map_entry_t* find_entry(hash_map_t* map, word key) {
+    if (map->entries == NULL) return NULL;
+    uint32_t mask = (uint32_t)map->capacity - 1;
+    for (uint32_t i = hash_key(key) & mask;; i = (i + 1) & mask) {
+        map_entry_t* e = &map->entries[i];
+        if (e->state == MAP_EMPTY) return NULL;
+        if (e->state == MAP_FULL && e->key == key) return e;
+    }
+}
+
+heap_object_t* new_map(ijvm* m) {
+    heap_object_t* obj = new_typed_array(m, TYPE_MAP, 0);
+    if (obj == NULL) return NULL;
+    hash_map_t* map = map_of(obj);
+    map->entries = NULL;
+    map->capacity = 0;
+    map->count = 0;
+    map->used = 0;
+    return obj;
+}
+
+bool map_get(heap_object_t* obj, word key, word* value, uint8_t* value_tag) {
+    map_entry_t* e = find_entry(map_of(obj), key);
+    if (e == NULL) return false;
+    *value = e->value;
+    *value_tag = e->value_tag;
+    return true;
+}
+
+// True if inserting one more key has to rebuild the table first. At most
+// 3/4 of the slots are kept in use, counting deleted ones.
+static bool needs_rehash(hash_map_t* map) {
+    return (map->used + 1) * 4 > map->capacity * 3;
+}
+
+// Capacity of the table rebuilt for the next insertion.
+static int rehash_capacity(hash_map_t* map) {
+    int capacity = map->capacity == 0 ? MAP_INITIAL_CAPACITY : map->capacity;
+    if ((map->count + 1) * 2 > capacity) capacity *= 2;
+    return capacity;
+}
+
+// Rebuilds the table with `capacity` slots, dropping deleted entries.
+// Returns false, leaving the map as it was, if no memory is left.
+static bool rehash(ijvm* m, hash_map_t* map, int capacity) {
+    size_t bytes = (size_t)capacity * sizeof(map_entry_t);
+    map_entry_t* entries = slab_calloc(&m->slabs, bytes);
+    if (entries == NULL) return false;
+    map_entry_t* old = map->entries;
+    int old_capacity = map->capacity;
+    map->entries = entries;
+    map->capacity = capacity;
+    map->used = map->count;
+    // Tables live in the old space, so they count towards the growth trigger
+    m->old_bytes_since_gc += bytes;
+    m->heap_bytes += bytes;
+    m->heap_bytes -= (size_t)old_capacity * sizeof(map_entry_t);
+    m->bytes_allocated += bytes;
+    m->bytes_freed += (size_t)old_capacity * sizeof(map_entry_t);
+
+    uint32_t mask = (uint32_t)capacity - 1;
+    for (int j = 0; j < old_capacity; j++) {
+        if (old[j].state != MAP_FULL) continue;
+        uint32_t i = hash_key(old[j].key) & mask;
+        while (map->entries[i].state != MAP_EMPTY) i = (i + 1) & mask;
+        map->entries[i] = old[j];
+    }
+    if (old) slab_free(&m->slabs, old, (size_t)old_capacity * sizeof(map_entry_t));
+    return true;
+}
+
+size_t map_put_bytes(heap_object_t* obj, word key) {
+    hash_map_t* map = map_of(obj);
+    if (!needs_rehash(map) || find_entry(map, key)) return 0;
+    return (size_t)(rehash_capacity(map) - map->capacity) * sizeof(map_entry_t);
+}
+
+bool map_put(ijvm* m, heap_object_t* obj, word key, uint8_t key_tag,
+             word value, uint8_t value_tag) {
+    hash_map_t* map = map_of(obj);
+    map_entry_t* e = find_entry(map, key);
+    if (e == NULL) {
+        if (needs_rehash(map) && !rehash(m, map, rehash_capacity(map))) return false;
+        uint32_t mask = (uint32_t)map->capacity - 1;
+        uint32_t i = hash_key(key) & mask;
+        while (map->entries[i].state == MAP_FULL) i = (i + 1) & mask;
+        e = &map->entries[i];
+        if (e->state == MAP_EMPTY) map->used++;
+        e->state = MAP_FULL;
+        e->key = key;
+        e->key_tag = key_tag;
+        map->count++;
+        rc_retain(m, key, key_tag);
+        write_barrier(m, obj, key, key_tag);
+    } else {
+        rc_release(m, e->value, e->value_tag);
+    }
+    e->value = value;
+    e->value_tag = value_tag;
+    rc_retain(m, value, value_tag);
+    write_barrier(m, obj, value, value_tag);
+    return true;
+}
+
+bool map_remove(ijvm* m, heap_object_t* obj, word key) {
+    hash_map_t* map = map_of(obj);
+    map_entry_t* e = find_entry(map, key);
+    if (e == NULL) return false;
+    rc_release(m, e->key, e->key_tag);
+    rc_release(m, e->value, e->value_tag);
+    // Leave a tombstone so probe chains through this slot stay intact
+    e->state = MAP_DELETED;
+    e->key_tag = 0;
+    e->value_tag = 0;
+    map->count--;
+    return true;
+}
+
+size_t map_table_bytes(heap_object_t* obj) {
+    return (size_t)map_of(obj)->capacity * sizeof(map_entry_t);
+}
+
+void free_map(ijvm* m, heap_object_t* obj) {
+    hash_map_t* map = map_of(obj);
+    if (map->entries) slab_free(&m->slabs, map->entries, map_table_bytes(obj));
+    map->entries = NULL;
+}
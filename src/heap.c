@@ -0,0 +1,366 @@
+#include <stdlib.h>
+#include <string.h>
+#include "heap.h"
+#include "gc.h"
+#include "hashmap.h"
+#include "profile.h"
+#include "refcount.h"
+#include "ijvm_ext.h"
+#include "arena.h"
+#include "slab.h"
+
+// Nursery allocations are rounded up so every header stays aligned
+#define NURSERY_ALIGN 8
+
+// Exhausted handle slots are only worth a scan of the whole heap once there
+// are this many of them, and at least a sixteenth of the table
+#define HANDLE_RECYCLE_MIN 1024
+
+static word make_reference(int slot, uint8_t generation) {
+    return (word)(((uint32_t)generation << HANDLE_INDEX_BITS) | (uint32_t)slot);
+}
+
+// Grows the handle table to at least `capacity` slots by doubling it.
+static bool grow_handles(ijvm* m, long long capacity) {
+    if (capacity > MAX_HEAP_HANDLES) capacity = MAX_HEAP_HANDLES;
+    if (capacity <= m->heap_capacity) return false;
+    long long new_capacity = m->heap_capacity == 0
+        ? m->options.initial_heap_objects : m->heap_capacity;
+    while (new_capacity < capacity) new_capacity *= 2;
+    if (new_capacity > MAX_HEAP_HANDLES) new_capacity = MAX_HEAP_HANDLES;
+    heap_handle_t* heap = realloc(m->heap, (size_t)new_capacity * sizeof(heap_handle_t));
+    if (heap == NULL) return false;
+    m->heap = heap;
+    m->heap_capacity = (int)new_capacity;
+    return true;
+}
+
+// Returns a free slot index. A full table is allocation pressure: collect
+// first, then grow the table unless the collection left room for another
+// gc_growth_factor times the live objects (but at least
+// initial_heap_objects), the same budget the byte trigger gives the old
+// space. Otherwise a mostly live table would be collected every few
+// allocations.
+static int take_handle(ijvm* m) {
+    if (m->free_handle < 0 && m->heap_size >= m->heap_capacity) {
+        // Reference counting frees most garbage without tracing
+        reconcile_counts(m);
+        if (m->free_handle < 0) collect_young(m);
+        // An incremental cycle cannot free anything right away, so the
+        // table still grows below while the cycle makes progress
+        if (m->free_handle < 0) request_collection(m, GC_TRIGGER_HANDLES);
+        if (m->free_handle < 0) recycle_exhausted_handles(m);
+
+        long long wanted = (long long)((double)m->live_objects * m->options.gc_growth_factor);
+        if (wanted < m->options.initial_heap_objects) wanted = m->options.initial_heap_objects;
+        long long used = (long long)m->live_objects + m->exhausted_handles;
+        if (m->heap_capacity - used < wanted) grow_handles(m, used + wanted);
+    }
+    if (m->free_handle >= 0) {
+        int slot = m->free_handle;
+        m->free_handle = m->heap[slot].next_free;
+        return slot;
+    }
+    if (m->heap_size >= m->heap_capacity && !grow_handles(m, (long long)m->heap_size + 1)) {
+        return -1;
+    }
+    int slot = m->heap_size++;
+    m->heap[slot].object = NULL;
+    m->heap[slot].generation = 1;
+    return slot;
+}
+
+size_t element_bytes(uint8_t type) {
+    switch (type) {
+    case ATYPE_UBYTE:
+    case ATYPE_BYTE:
+        return 1;
+    case ATYPE_CHAR:
+    case ATYPE_SHORT:
+        return 2;
+    default:
+        return sizeof(word);
+    }
+}
+
+size_t array_data_bytes(uint8_t type, int count) {
+    if (type == TYPE_MAP) return sizeof(hash_map_t);
+    return (size_t)count * element_bytes(type);
+}
+
+size_t object_bytes(uint8_t type, int count) {
+    return sizeof(heap_object_t) + array_data_bytes(type, count);
+}
+
+size_t nursery_footprint(uint8_t type, int count) {
+    return (object_bytes(type, count) + NURSERY_ALIGN - 1) & ~(size_t)(NURSERY_ALIGN - 1);
+}
+
+// Bump-allocates a zeroed object in the nursery, running a minor collection
+// first if it is full.
+static heap_object_t* nursery_alloc(ijvm* m, uint8_t type, word count) {
+    size_t footprint = nursery_footprint(type, count);
+    if (m->nursery == NULL) {
+        m->nursery = arena_alloc(&m->arena, m->options.nursery_bytes);
+        if (m->nursery == NULL) return NULL;
+        m->nursery_used = 0;
+    }
+    if (m->nursery_used + footprint > m->options.nursery_bytes) {
+        collect_young(m);
+    }
+    heap_object_t* obj = (heap_object_t*)(m->nursery + m->nursery_used);
+    m->nursery_used += footprint;
+    obj->data = (word*)(obj + 1);
+    memset(obj->data, 0, array_data_bytes(type, count));
+    obj->space = SPACE_NURSERY;
+    return obj;
+}
+
+static heap_object_t* old_alloc(ijvm* m, uint8_t type, word count) {
+    release_retired(m, LAZY_FREE_BATCH);
+    size_t bytes = object_bytes(type, count);
+    heap_object_t* obj = slab_calloc(&m->slabs, bytes);
+    if (obj == NULL) return NULL;
+    m->old_bytes_since_gc += bytes;
+    obj->data = (word*)(obj + 1);
+    obj->space = SPACE_OLD;
+    return obj;
+}
+
+heap_object_t* new_array(ijvm* m, word count) {
+    return new_typed_array(m, ATYPE_INT, count);
+}
+
+heap_object_t* new_typed_array(ijvm* m, uint8_t type, word count) {
+    if (m->gc_phase == GC_MARKING) gc_slice(m);
+    if (m->zct_size >= m->zct_trigger) reconcile_counts(m);
+    int slot = take_handle(m);
+    if (slot < 0) return NULL;
+
+    bool young = m->options.nursery_bytes > 0 && nursery_footprint(type, count)
+        <= m->options.nursery_bytes / NURSERY_PRETENURE_FRACTION;
+    heap_object_t* obj = young ? nursery_alloc(m, type, count) : old_alloc(m, type, count);
+    if (obj == NULL) {
+        m->heap[slot].object = NULL;
+        m->heap[slot].next_free = m->free_handle;
+        m->free_handle = slot;
+        return NULL;
+    }
+    obj->size = count;
+    obj->type = type;
+    obj->tags = NULL;
+    // Old objects created during an incremental cycle are allocated black
+    obj->marked = !young && m->gc_phase == GC_MARKING;
+    obj->remembered = false;
+    obj->reference = make_reference(slot, m->heap[slot].generation);
+
+    m->heap[slot].object = obj;
+    rc_track(m, obj);
+    m->live_objects++;
+    m->heap_bytes += array_data_bytes(type, count);
+    m->bytes_allocated += array_data_bytes(type, count);
+    return obj;
+}
+
+heap_object_t* find_heap_object(ijvm* m, word ref) {
+    uint32_t slot = (uint32_t)ref & HANDLE_INDEX_MASK;
+    if (slot >= (uint32_t)m->heap_size) return NULL;
+    heap_handle_t* handle = &m->heap[slot];
+    if (((uint32_t)ref >> HANDLE_INDEX_BITS) != handle->generation) return NULL;
+    return handle->object;
+}
+
+uint8_t* alloc_tags(ijvm* m, heap_object_t* obj) {
+    if (obj->tags == NULL) obj->tags = slab_calloc(&m->slabs, (size_t)obj->size);
+    return obj->tags;
+}
+
+// Frees what an object owns besides its own block.
+static void free_side_tables(ijvm* m, heap_object_t* obj) {
+    if (obj->tags) slab_free(&m->slabs, obj->tags, (size_t)obj->size);
+    if (obj->type == TYPE_MAP) free_map(m, obj);
+}
+
+// Gives an object's memory back to the allocator it came from.
+static void release_object(ijvm* m, heap_object_t* obj) {
+    free_side_tables(m, obj);
+    // Nursery memory is reclaimed wholesale when the nursery is reset
+    if (obj->space == SPACE_OLD) slab_free(&m->slabs, obj, object_bytes(obj->type, obj->size));
+}
+
+static void invalidate_handle(ijvm* m, heap_object_t* obj) {
+    if (m->profile) profile_free(m, obj);
+    int slot = (int)((uint32_t)obj->reference & HANDLE_INDEX_MASK);
+    heap_handle_t* handle = &m->heap[slot];
+
+    handle->object = NULL;
+    if (handle->generation >= HANDLE_GENERATION_MASK) {
+        // Wrapping would let references from the first generation resolve
+        // again, so the slot waits for recycle_exhausted_handles()
+        handle->generation = 0;
+        handle->next_free = -1;
+        m->exhausted_handles++;
+    } else {
+        handle->generation++;
+        handle->next_free = m->free_handle;
+        m->free_handle = slot;
+    }
+
+    m->live_objects--;
+    size_t bytes = array_data_bytes(obj->type, obj->size);
+    if (obj->type == TYPE_MAP) bytes += map_table_bytes(obj);
+    m->heap_bytes -= bytes;
+    m->bytes_freed += bytes;
+}
+
+// Sets pinned[slot] if `value` could be a reference to the exhausted slot.
+static void pin_exhausted(ijvm* m, uint8_t* pinned, word value) {
+    uint32_t slot = (uint32_t)value & HANDLE_INDEX_MASK;
+    uint32_t generation = (uint32_t)value >> HANDLE_INDEX_BITS;
+    if (slot >= (uint32_t)m->heap_size || generation == 0
+        || generation > HANDLE_GENERATION_MASK) return;
+    if (m->heap[slot].object == NULL && m->heap[slot].generation == 0) pinned[slot] = 1;
+}
+
+void recycle_exhausted_handles(ijvm* m) {
+    if (m->exhausted_handles < HANDLE_RECYCLE_MIN
+        || m->exhausted_handles < m->heap_size / 16) return;
+    uint8_t* pinned = calloc((size_t)m->heap_size, 1);
+    if (pinned == NULL) return;
+
+    // Every word counts, tagged or not, as find_heap_object() takes any word
+    Stack* s = m->stack;
+    for (int i = 0; i <= s->top; i++) pin_exhausted(m, pinned, s->elements[i]);
+    for (int i = 0; i < m->heap_size; i++) {
+        heap_object_t* obj = m->heap[i].object;
+        if (obj == NULL) continue;
+        if (obj->type == TYPE_MAP) {
+            hash_map_t* map = map_of(obj);
+            for (int j = 0; j < map->capacity; j++) {
+                if (map->entries[j].state != MAP_FULL) continue;
+                pin_exhausted(m, pinned, map->entries[j].key);
+                pin_exhausted(m, pinned, map->entries[j].value);
+            }
+        } else if (obj->type == ATYPE_INT) {
+            // Narrower elements cannot hold a reference
+            for (int j = 0; j < obj->size; j++) pin_exhausted(m, pinned, obj->data[j]);
+        }
+    }
+    for (int i = 0; i < m->zct_size; i++) pin_exhausted(m, pinned, m->zct[i]);
+
+    for (int i = 0; i < m->heap_size; i++) {
+        heap_handle_t* handle = &m->heap[i];
+        if (handle->object != NULL || handle->generation != 0 || pinned[i]) continue;
+        handle->generation = 1;
+        handle->next_free = m->free_handle;
+        m->free_handle = i;
+        m->exhausted_handles--;
+    }
+    free(pinned);
+}
+
+void free_heap_object(ijvm* m, heap_object_t* obj) {
+    invalidate_handle(m, obj);
+    release_object(m, obj);
+}
+
+void retire_heap_object(ijvm* m, heap_object_t* obj) {
+    invalidate_handle(m, obj);
+    mark_push(&m->retired, obj);
+}
+
+void release_retired(ijvm* m, int budget) {
+    mark_stack_t* retired = &m->retired;
+    while (retired->size > 0 && budget != 0) {
+        release_object(m, retired->items[--retired->size]);
+        if (budget > 0) budget--;
+    }
+}
+
+heap_object_t* promote_object(ijvm* m, heap_object_t* obj) {
+    size_t bytes = object_bytes(obj->type, obj->size);
+    heap_object_t* old = slab_alloc(&m->slabs, bytes);
+    if (old == NULL) return NULL;
+    m->old_bytes_since_gc += bytes;
+    memcpy(old, obj, bytes);
+    old->data = (word*)(old + 1);
+    old->space = SPACE_OLD;
+    old->marked = false;
+    old->remembered = false;
+
+    int slot = (int)((uint32_t)obj->reference & HANDLE_INDEX_MASK);
+    m->heap[slot].object = old;
+    return old;
+}
+
+// A set that cannot grow would let a minor collection free a young object
+// that is still referenced, so the machine stops instead.
+static void remember(ijvm* m, heap_object_t* obj) {
+    if (m->remembered_size >= m->remembered_capacity) {
+        int capacity = m->remembered_capacity == 0 ? 16 : m->remembered_capacity * 2;
+        heap_object_t** remembered = realloc(m->remembered,
+                                             (size_t)capacity * sizeof(heap_object_t*));
+        if (remembered == NULL) {
+            m->halted = true;
+            return;
+        }
+        m->remembered = remembered;
+        m->remembered_capacity = capacity;
+    }
+    obj->remembered = true;
+    m->remembered[m->remembered_size++] = obj;
+}
+
+void write_barrier(ijvm* m, heap_object_t* obj, word value, uint8_t tag) {
+    if (m->gc_phase == GC_MARKING) shade_reference(m, value, tag);
+    if (obj->space != SPACE_OLD || obj->remembered) return;
+    if (m->options.precise_gc && !tag) return;
+    heap_object_t* target = find_heap_object(m, value);
+    if (target != NULL && target->space == SPACE_NURSERY) remember(m, obj);
+}
+
+void write_barrier_range(ijvm* m, heap_object_t* obj, int from, int count) {
+    bool marking = m->gc_phase == GC_MARKING;
+    if (!marking && (obj->space != SPACE_OLD || obj->remembered)) return;
+    if (m->options.precise_gc && obj->tags == NULL) return;
+    for (int i = from; i < from + count; i++) {
+        write_barrier(m, obj, obj->data[i], obj->tags ? obj->tags[i] : 0);
+        // Once remembered, only a running cycle still needs to see the rest
+        if (!marking && obj->remembered) return;
+    }
+}
+
+// Frees an object's blocks that live outside the arena.
+static void free_outside_blocks(ijvm* m, heap_object_t* obj) {
+    if (obj->tags && (size_t)obj->size > SLAB_MAX_BLOCK) {
+        slab_free(&m->slabs, obj->tags, (size_t)obj->size);
+    }
+    if (obj->type == TYPE_MAP && map_table_bytes(obj) > SLAB_MAX_BLOCK) free_map(m, obj);
+    size_t bytes = object_bytes(obj->type, obj->size);
+    if (obj->space == SPACE_OLD && bytes > SLAB_MAX_BLOCK) slab_free(&m->slabs, obj, bytes);
+}
+
+void destroy_heap(ijvm* m) {
+    // Everything else, nursery and slab chunks included, goes back to the
+    // pool with the arena. Most short-lived VMs never allocate a block
+    // that large, so teardown does not depend on the number of objects.
+    for (int i = 0; i < m->heap_size && m->slabs.outside > 0; i++) {
+        heap_object_t* obj = m->heap[i].object;
+        if (obj) free_outside_blocks(m, obj);
+    }
+    for (int i = 0; i < m->retired.size && m->slabs.outside > 0; i++) {
+        free_outside_blocks(m, m->retired.items[i]);
+    }
+    free(m->retired.items);
+    memset(&m->retired, 0, sizeof(m->retired));
+    init_slabs(&m->slabs, &m->arena);
+    free(m->heap);
+    free(m->remembered);
+    m->heap = NULL;
+    m->heap_size = 0;
+    m->heap_capacity = 0;
+    m->nursery = NULL;
+    m->remembered = NULL;
+    m->remembered_size = 0;
+    m->remembered_capacity = 0;
+}
@@ -3,31 +3,136 @@
 #include <string.h>
 #include "ijvm.h"
 #include "util.h" // read this file for debug prints, endianness helper functions
+#include "ijvm_ext.h"
+#include "arena.h"
+#include "loader.h"
+#include "hashmap.h"
+#include "heap.h"
+#include "profile.h"
+#include "refcount.h"
+#include "gc.h"
+#include "slab.h"
+#include "vector.h"
+
+// Number of consecutive method returns the stack has to stay below a
+// quarter of its capacity before the unused tail is handed back.
+#define STACK_SHRINK_TICKS 64
+
+#define DEFAULT_STACK_WORDS 2048
+#define DEFAULT_MAIN_FRAME_SLOTS 1024
+#define DEFAULT_HEAP_OBJECTS 16
+#define DEFAULT_NURSERY_BYTES (256 * 1024)
+#define DEFAULT_GC_SLICE_OBJECTS 128
+#define DEFAULT_GC_GROWTH_FACTOR 1.0
+#define DEFAULT_GC_MIN_TRIGGER_BYTES (1024 * 1024)
+#define DEFAULT_RC_BATCH_OBJECTS 1024
 
 
 // --- Stack Utilities ---
 Stack* create_stack(int capacity) {
     Stack* s = (Stack*) malloc(sizeof(Stack));
     s->capacity = capacity;
+    s->min_capacity = capacity;
+    s->peak_capacity = capacity;
+    s->low_water_ticks = 0;
+    s->max_capacity = 0;
+    s->overflowed = false;
     s->top = -1;
     s->elements = (word*) malloc(s->capacity * sizeof(word));
+    s->tags = (uint8_t*) malloc(s->capacity);
     return s;
 }
 
 void destroy_stack(Stack* s) {
     if (s) {
       free(s->elements);
+      free(s->tags);
       free(s);
     }
 }
 
-void push(Stack* s, word value) {
-    if (s->top >= s->capacity - 1) {
-      s->capacity *= 2;
-      s->elements = (word*) realloc(s->elements, s->capacity * sizeof(word));
+// Grows the stack so that at least `count` more elements fit. Returns false
+// (and sets s->overflowed) if that would exceed s->max_capacity or memory
+// runs out; s->capacity only grows once both buffers have.
+static bool grow(Stack* s, int count) {
+    int needed = s->top + 1 + count;
+    if (s->max_capacity > 0 && needed > s->max_capacity) {
+      s->overflowed = true;
+      return false;
+    }
+    int new_capacity = s->capacity;
+    while (needed > new_capacity) new_capacity *= 2;
+    if (s->max_capacity > 0 && new_capacity > s->max_capacity) {
+      new_capacity = s->max_capacity;
+    }
+    word* elements = (word*) realloc(s->elements, new_capacity * sizeof(word));
+    if (elements == NULL) {
+      s->overflowed = true;
+      return false;
     }
+    s->elements = elements;
+    uint8_t* tags = (uint8_t*) realloc(s->tags, new_capacity);
+    if (tags == NULL) {
+      s->overflowed = true;
+      return false;
+    }
+    s->tags = tags;
+    s->capacity = new_capacity;
+    if (s->capacity > s->peak_capacity) s->peak_capacity = s->capacity;
+    return true;
+}
+
+// Makes sure at least `count` more elements fit without reallocating.
+bool ensure_capacity(Stack* s, int count) {
+    if (s->top + count < s->capacity) return true;
+    return grow(s, count);
+}
+
+// Pushes a value together with its reference tag.
+void push_tagged(Stack* s, word value, uint8_t tag) {
+    if (s->top >= s->capacity - 1 && !grow(s, 1)) return;
     s->top++;
     s->elements[s->top] = value;
+    s->tags[s->top] = tag;
+}
+
+// Pushes a plain integer.
+void push(Stack* s, word value) {
+    push_tagged(s, value, 0);
+}
+
+// Pushes `count` zeroes with a single capacity check, used for frame locals.
+void push_zeros(Stack* s, int count) {
+    if (count <= 0 || !ensure_capacity(s, count)) return;
+    memset(&s->elements[s->top + 1], 0, count * sizeof(word));
+    memset(&s->tags[s->top + 1], 0, count);
+    s->top += count;
+}
+
+// Called after frames are unwound. Once the stack has stayed below a quarter
+// of its capacity for STACK_SHRINK_TICKS returns, the allocation is shrunk
+// back so that it is at most half full.
+void shrink_if_idle(Stack* s) {
+    if (s->capacity <= s->min_capacity || s->top + 1 >= s->capacity / 4) {
+      s->low_water_ticks = 0;
+      return;
+    }
+    if (++s->low_water_ticks < STACK_SHRINK_TICKS) return;
+    s->low_water_ticks = 0;
+
+    int new_capacity = s->capacity;
+    while (new_capacity / 2 >= s->min_capacity && s->top + 1 <= new_capacity / 4) {
+      new_capacity /= 2;
+    }
+    // s->capacity must never exceed either buffer. It drops as soon as the
+    // elements have shrunk; a tags buffer that fails to shrink is merely
+    // left larger than needed.
+    word* shrunk = (word*) realloc(s->elements, new_capacity * sizeof(word));
+    if (shrunk == NULL) return;
+    s->elements = shrunk;
+    s->capacity = new_capacity;
+    uint8_t* shrunk_tags = (uint8_t*) realloc(s->tags, new_capacity);
+    if (shrunk_tags) s->tags = shrunk_tags;
 }
 
 word pop(Stack* s) {
@@ -36,9 +141,68 @@ word pop(Stack* s) {
 }
 
 
+// Stops the machine for a reason that get_halt_reason() should report.
+static void halt_with(ijvm* m, ijvm_halt_reason reason) {
+    m->halted = true;
+    m->halt_reason = reason;
+}
+
+// Charges `count` instructions against limits.max_instructions. This is only
+// called at back-edges and calls: every unbounded execution passes through
+// one of those, so straight-line code never needs to be counted.
+static bool charge_instructions(ijvm* m, long long count) {
+    if (m->options.limits.max_instructions == 0) return true;
+    m->instructions_charged += count;
+    if (m->instructions_charged > m->options.limits.max_instructions) {
+      halt_with(m, IJVM_HALT_INSTRUCTION_LIMIT);
+      return false;
+    }
+    return true;
+}
+
+// A branch to `offset` from its own opcode. Backward branches are charged
+// with the size of the loop body, an upper bound on its instruction count,
+// and give a running incremental collection a slice.
+static bool charge_branch(ijvm* m, int16_t offset) {
+    if (offset > 0) return true;
+    if (m->gc_phase == GC_MARKING) gc_slice(m);
+    return charge_instructions(m, 3 - (long long)offset);
+}
+
 // see ijvm.h for descriptions of the below functions
 
+void default_ijvm_options(ijvm_options* opts)
+{
+  opts->initial_stack_words = DEFAULT_STACK_WORDS;
+  opts->main_frame_slots = DEFAULT_MAIN_FRAME_SLOTS;
+  opts->initial_heap_objects = DEFAULT_HEAP_OBJECTS;
+  opts->precise_gc = true;
+  opts->nursery_bytes = DEFAULT_NURSERY_BYTES;
+  opts->incremental_gc = false;
+  opts->gc_slice_objects = DEFAULT_GC_SLICE_OBJECTS;
+  opts->gc_slice_micros = 0;
+  opts->compact_percent = 0;
+  opts->gc_threads = 1;
+  opts->reference_counting = false;
+  opts->rc_batch_objects = DEFAULT_RC_BATCH_OBJECTS;
+  opts->gc_growth_factor = DEFAULT_GC_GROWTH_FACTOR;
+  opts->gc_min_trigger_bytes = DEFAULT_GC_MIN_TRIGGER_BYTES;
+  opts->gc_hook = NULL;
+  opts->gc_hook_data = NULL;
+  opts->heap_stats_hook = NULL;
+  opts->heap_stats_hook_data = NULL;
+  opts->heap_profile = false;
+  opts->heap_profile_out = NULL;
+  memset(&opts->limits, 0, sizeof(opts->limits));
+}
+
 ijvm* init_ijvm(char *binary_path, FILE* input, FILE* output)
+{
+  return init_ijvm_with_options(binary_path, input, output, NULL);
+}
+
+ijvm* init_ijvm_with_options(char *binary_path, FILE* input, FILE* output,
+                             const ijvm_options* opts)
 {
   // do not change these first three lines
   ijvm* m = (ijvm *) malloc(sizeof(ijvm));
@@ -49,73 +213,88 @@ ijvm* init_ijvm(char *binary_path, FILE* input, FILE* output)
   m->in = input;
   m->out = output;
   m->halted = false;
-  
-  FILE *binary = fopen(binary_path, "rb");
-  if (!binary) { free(m); return NULL; }
-
-  fseek(binary, 0, SEEK_END);
-  long file_size = ftell(binary);
-  fseek(binary, 0, SEEK_SET);
-
-  byte magic_buf[4];
-  if (fread(magic_buf, 4, 1, binary) != 1 || read_uint32(magic_buf) != 0x1DEADFAD) {
-    fclose(binary); free(m); return NULL;
+  m->halt_reason = IJVM_HALT_NONE;
+  m->instructions_charged = 0;
+
+  if (opts) m->options = *opts;
+  else default_ijvm_options(&m->options);
+  if (m->options.main_frame_slots < 0) m->options.main_frame_slots = 0;
+  if (m->options.initial_stack_words <= m->options.main_frame_slots) {
+    m->options.initial_stack_words = m->options.main_frame_slots + 1;
   }
-
-  fseek(binary, 8, SEEK_SET);
-  byte constants_size_buf[4];
-  if(fread(constants_size_buf, 4, 1, binary) != 1) { fclose(binary); free(m); return NULL; }
-    
-  m->constant_pool_size = read_uint32(constants_size_buf);
-
-  if ((ftell(binary) + m->constant_pool_size) > (unsigned long)file_size) { fclose(binary); free(m); return NULL; }
-
-  m->constant_pool = (word*) malloc(m->constant_pool_size == 0 ? 4 : m->constant_pool_size);
-  if (!m->constant_pool) { fclose(binary); free(m); return NULL; }
-    
-  if (m->constant_pool_size > 0) {
-    if (fread(m->constant_pool, m->constant_pool_size, 1, binary) != 1) {
-      free(m->constant_pool); fclose(binary); free(m); return NULL;
-    }
+  if (m->options.limits.max_stack_words > 0
+      && m->options.initial_stack_words > m->options.limits.max_stack_words) {
+    m->options.initial_stack_words = m->options.limits.max_stack_words;
   }
-  for (uint32_t i = 0; i < m->constant_pool_size / 4; i++) {
-    m->constant_pool[i] = swap_uint32(m->constant_pool[i]);
+  if (m->options.initial_heap_objects < 1) m->options.initial_heap_objects = 1;
+  if (m->options.gc_slice_objects < 1) m->options.gc_slice_objects = 1;
+  if (m->options.rc_batch_objects < 1) m->options.rc_batch_objects = 1;
+  if (m->options.reference_counting) {
+    // Counts follow tagged references only. Minor and incremental
+    // collections would free objects without dropping the counts they
+    // hold, so only full collections, which rebuild every count, remain.
+    // Moving objects is fine: the ZCT lists references, not pointers.
+    m->options.precise_gc = true;
+    m->options.nursery_bytes = 0;
+    m->options.incremental_gc = false;
   }
+  init_arena(&m->arena);
 
-  fseek(binary, 16 + m->constant_pool_size, SEEK_SET);
-  byte text_size_buf[4];
-  if(fread(text_size_buf, 4, 1, binary) != 1) { free(m->constant_pool); fclose(binary); free(m); return NULL; }
-  m->text_size = read_uint32(text_size_buf);
-  if ((ftell(binary) + m->text_size) > (unsigned long)file_size) {
-    free(m->constant_pool); fclose(binary); free(m); return NULL;
+  if (!load_binary(m, binary_path)) {
+    release_arena(&m->arena);
+    free(m);
+    return NULL;
   }
 
-  m->text = (byte*) malloc(m->text_size);
-  if (!m->text) { free(m->constant_pool); fclose(binary); free(m); return NULL; }
-    
-  if (m->text_size > 0) {
-    if (fread(m->text, m->text_size, 1, binary) != 1) {
-      free(m->constant_pool); free(m->text); fclose(binary); free(m); return NULL;
-    }
-  }
-  fclose(binary);
-
-  m->stack = create_stack(65536);
+  m->stack = create_stack(m->options.initial_stack_words);
+  m->stack->max_capacity = m->options.limits.max_stack_words;
   m->program_counter = 0;
   m->lv_pointer = 0;
-  for (int i = 0; i < 1024; ++i) push(m->stack, 0);
+  push_zeros(m->stack, m->options.main_frame_slots);
+  // A stack limit smaller than the main frame leaves nothing to run
+  if (m->stack->overflowed) halt_with(m, IJVM_HALT_STACK_LIMIT);
     
-  // Initialize heap
-  m->heap_capacity = 16;
+  // The handle table is only allocated once the program creates an array
+  m->heap_capacity = 0;
   m->heap_size = 0;
-  m->heap = malloc(m->heap_capacity * sizeof(heap_object_t*));
-  m->next_ref = 100; // Start refs from a non-trivial number
+  m->heap = NULL;
+  m->free_handle = -1;
+  m->exhausted_handles = 0;
+  m->live_objects = 0;
+  m->heap_bytes = 0;
+  m->nursery = NULL;
+  m->nursery_used = 0;
+  m->remembered = NULL;
+  m->remembered_size = 0;
+  m->remembered_capacity = 0;
+  init_slabs(&m->slabs, &m->arena);
+  memset(&m->mark_stack, 0, sizeof(m->mark_stack));
+  m->gc_young_only = false;
+  m->gc_phase = GC_IDLE;
+  memset(&m->grey, 0, sizeof(m->grey));
+  memset(&m->retired, 0, sizeof(m->retired));
+  m->pause_ns = NULL;
+  m->pause_count = 0;
+  m->profile = m->options.heap_profile ? create_heap_profile() : NULL;
+  m->zct = NULL;
+  m->zct_size = 0;
+  m->zct_capacity = 0;
+  m->zct_trigger = m->options.rc_batch_objects;
+  m->reconciliations = 0;
+  m->minor_collections = 0;
+  m->full_collections = 0;
+  m->incremental_cycles = 0;
+  m->bytes_allocated = 0;
+  m->bytes_freed = 0;
+  m->old_bytes_since_gc = 0;
+  m->live_after_gc = 0;
 
   return m;
 }
 
 // --- Method Invocation Logic ---
 void invoke_method(ijvm* m, uint16_t method_index) {
+    if (!charge_instructions(m, 1)) return;
     if (method_index >= (m->constant_pool_size / 4)) { m->halted = true; return; }
     uint32_t method_address = get_constant(m, method_index);
     if (method_address + 3 >= m->text_size) { m->halted = true; return; }
@@ -128,18 +307,21 @@ void invoke_method(ijvm* m, uint16_t method_index) {
     int new_lv = m->stack->top - (num_params - 1);
     int link_ptr_target = new_lv + num_params + num_locals;
 
-    for (int i=0; i < num_locals; ++i) push(m->stack, 0);
+    push_zeros(m->stack, num_locals);
+    if (m->stack->overflowed) return;
 
     push(m->stack, m->program_counter);
     push(m->stack, m->lv_pointer);
 
     m->stack->elements[new_lv] = link_ptr_target;
+    m->stack->tags[new_lv] = 0;
     m->lv_pointer = new_lv;
     m->program_counter = method_address + 4;
 }
 
 void return_from_method(ijvm* m) {
     if (m->stack->top < 0) { m->halted = true; return; }
+    uint8_t return_tag = m->stack->tags[m->stack->top];
     word return_value = pop(m->stack);
 
     if (m->lv_pointer == 0) { m->halted = true; return; }
@@ -154,31 +336,21 @@ void return_from_method(ijvm* m) {
     m->program_counter = restored_pc;
     m->lv_pointer = restored_lv;
 
-    push(m->stack, return_value);
-}
-
-heap_object_t* find_heap_object(ijvm* m, word ref){
-  for (int i = 0; i < m->heap_size; i++) {
-    if (m->heap[i]->reference == ref) {
-      return m->heap[i];
-    }
-  }
-  return NULL;
+    push_tagged(m->stack, return_value, return_tag);
+    shrink_if_idle(m->stack);
 }
 
 void destroy_ijvm(ijvm* m) 
 {
-  // Free all remaining heap objects
-  for (int i = 0; i < m->heap_size; i++) {
-    if (m->heap[i]) {
-      free(m->heap[i]->data);
-      free(m->heap[i]);
-    }
+  if (m->profile && m->options.heap_profile_out) {
+    dump_heap_profile(m, m->options.heap_profile_out);
   }
-  free(m->heap);
+  destroy_heap(m);
+  destroy_heap_profile(m->profile);
+  destroy_gc(m);
   destroy_stack(m->stack);
-  free(m->text);
-  free(m->constant_pool);
+  unload_binary(m);
+  release_arena(&m->arena);
   free(m);
 }
 
@@ -217,6 +389,229 @@ word get_local_variable(ijvm* m, int i)
     return m->stack->elements[m->lv_pointer + i];
 }
 
+// Pops an element count and pushes a new zeroed array of `type`. The
+// collector gets a chance to run first, then the budgets are checked. `pc`
+// is the address of the instruction, for the heap profiler.
+static void new_array_instruction(ijvm* m, uint8_t type, int pc) {
+    if (m->stack->top < 0) { m->halted = true; return; }
+    word count = pop(m->stack);
+    if (count < 0 || (size_t)count > MAX_ARRAY_WORDS) { m->halted = true; return; }
+
+    size_t bytes = array_data_bytes(type, count);
+    collect_if_needed(m, bytes);
+    if (m->options.limits.max_live_arrays > 0
+        && m->live_objects >= m->options.limits.max_live_arrays) {
+        halt_with(m, IJVM_HALT_ARRAY_LIMIT);
+        return;
+    }
+    if (!heap_limit_allows(m, bytes)) {
+        halt_with(m, IJVM_HALT_HEAP_LIMIT);
+        return;
+    }
+
+    heap_object_t* new_obj = new_typed_array(m, type, count);
+    if (new_obj == NULL) { m->halted = true; return; }
+    if (m->profile) profile_allocation(m, new_obj, pc);
+    push_tagged(m->stack, new_obj->reference, 1);
+}
+
+// Returns the array `arrayref` refers to if `index` is in range and its
+// elements are `width` bytes wide. Otherwise reports the error and halts.
+static heap_object_t* array_element(ijvm* m, word arrayref, word index, size_t width) {
+    heap_object_t* obj = find_heap_object(m, arrayref);
+    if (obj == NULL || index < 0 || index >= obj->size) {
+        fprintf(m->out, "ERROR: Array index out of bounds.\n");
+        m->halted = true;
+        return NULL;
+    }
+    if (element_bytes(obj->type) != width) {
+        fprintf(m->out, "ERROR: Wrong array type.\n");
+        m->halted = true;
+        return NULL;
+    }
+    return obj;
+}
+
+// Returns the array `arrayref` refers to if it has the elements
+// [offset, offset + length). Otherwise reports the error and halts.
+static heap_object_t* array_range(ijvm* m, word arrayref, word offset, word length) {
+    heap_object_t* obj = find_heap_object(m, arrayref);
+    if (obj == NULL || offset < 0 || length < 0 || (int64_t)offset + length > obj->size) {
+        fprintf(m->out, "ERROR: Array index out of bounds.\n");
+        m->halted = true;
+        return NULL;
+    }
+    return obj;
+}
+
+static void array_copy_instruction(ijvm* m) {
+    if (m->stack->top < 4) { m->halted = true; return; }
+    word length = pop(m->stack);
+    word dst_offset = pop(m->stack);
+    word dstref = pop(m->stack);
+    word src_offset = pop(m->stack);
+    word srcref = pop(m->stack);
+    heap_object_t* src = array_range(m, srcref, src_offset, length);
+    heap_object_t* dst = src ? array_range(m, dstref, dst_offset, length) : NULL;
+    if (dst == NULL) return;
+    size_t width = element_bytes(src->type);
+    if (element_bytes(dst->type) != width) {
+        fprintf(m->out, "ERROR: Wrong array type.\n");
+        m->halted = true;
+        return;
+    }
+
+    // Copied references need tags at the destination; get them before
+    // anything changes
+    if (dst->type == ATYPE_INT && src->tags && alloc_tags(m, dst) == NULL) {
+        m->halted = true;
+        return;
+    }
+    if (dst->type == ATYPE_INT) rc_release_range(m, dst, dst_offset, length);
+    memmove((uint8_t*)dst->data + (size_t)dst_offset * width,
+            (uint8_t*)src->data + (size_t)src_offset * width, (size_t)length * width);
+    if (dst->type != ATYPE_INT) return;
+    if (src->tags) {
+        memmove(dst->tags + dst_offset, src->tags + src_offset, (size_t)length);
+    } else if (dst->tags) {
+        memset(dst->tags + dst_offset, 0, (size_t)length);
+    }
+    rc_retain_range(m, dst, dst_offset, length);
+    write_barrier_range(m, dst, dst_offset, length);
+}
+
+static void array_fill_instruction(ijvm* m) {
+    if (m->stack->top < 3) { m->halted = true; return; }
+    uint8_t value_tag = m->stack->tags[m->stack->top];
+    word value = pop(m->stack);
+    word length = pop(m->stack);
+    word offset = pop(m->stack);
+    word arrayref = pop(m->stack);
+    heap_object_t* obj = array_range(m, arrayref, offset, length);
+    if (obj == NULL || length <= 0) return;
+
+    switch (element_bytes(obj->type)) {
+    case 1:
+        memset((uint8_t*)obj->data + offset, (uint8_t)value, (size_t)length);
+        break;
+    case 2: {
+        uint16_t* elements = (uint16_t*)obj->data + offset;
+        for (int i = 0; i < length; i++) elements[i] = (uint16_t)value;
+        break;
+    }
+    default: {
+        if (value_tag && alloc_tags(m, obj) == NULL) { m->halted = true; break; }
+        rc_release_range(m, obj, offset, length);
+        word* elements = obj->data + offset;
+        for (int i = 0; i < length; i++) elements[i] = value;
+        if (obj->tags) memset(obj->tags + offset, value_tag, (size_t)length);
+        rc_retain_range(m, obj, offset, length);
+        // Every element holds the same value, so one barrier covers them all
+        if (length > 0) write_barrier(m, obj, value, value_tag);
+        break;
+    }
+    }
+}
+
+// Like array_range(), but also requires a word array.
+static heap_object_t* word_range(ijvm* m, word arrayref, word offset, word length) {
+    heap_object_t* obj = array_range(m, arrayref, offset, length);
+    if (obj != NULL && obj->type != ATYPE_INT) {
+        fprintf(m->out, "ERROR: Wrong array type.\n");
+        m->halted = true;
+        return NULL;
+    }
+    return obj;
+}
+
+static void vector_op_instruction(ijvm* m, int op) {
+    if (m->stack->top < 4 || op > VEC_OR) { m->halted = true; return; }
+    word length = pop(m->stack);
+    word offset = pop(m->stack);
+    word dstref = pop(m->stack);
+    word bref = pop(m->stack);
+    word aref = pop(m->stack);
+    heap_object_t* a = word_range(m, aref, offset, length);
+    heap_object_t* b = a ? word_range(m, bref, offset, length) : NULL;
+    heap_object_t* dst = b ? word_range(m, dstref, offset, length) : NULL;
+    if (dst == NULL) return;
+
+    rc_release_range(m, dst, offset, length);
+    vector_binary(op, dst->data + offset, a->data + offset, b->data + offset, length);
+    // The results are plain integers
+    if (dst->tags) memset(dst->tags + offset, 0, (size_t)length);
+    if (!m->options.precise_gc) write_barrier_range(m, dst, offset, length);
+}
+
+static void vector_reduce_instruction(ijvm* m, int op) {
+    if (m->stack->top < 2 || op > VEC_MAX) { m->halted = true; return; }
+    word length = pop(m->stack);
+    word offset = pop(m->stack);
+    word arrayref = pop(m->stack);
+    heap_object_t* obj = word_range(m, arrayref, offset, length);
+    if (obj == NULL) return;
+    push(m->stack, vector_reduce(op, obj->data + offset, length));
+}
+
+// Returns the map `mapref` refers to, or reports the error and halts.
+static heap_object_t* find_map(ijvm* m, word mapref) {
+    heap_object_t* obj = find_heap_object(m, mapref);
+    if (obj == NULL || obj->type != TYPE_MAP) {
+        fprintf(m->out, "ERROR: Not a map.\n");
+        m->halted = true;
+        return NULL;
+    }
+    return obj;
+}
+
+// Pops map, key and value and stores the pair. A table that has to grow is
+// charged against the heap budget like a new array, before the operands are
+// popped. Only tagged operands keep their objects alive across that
+// collection, so the map is looked up again afterwards.
+static void map_put_instruction(ijvm* m) {
+    Stack* s = m->stack;
+    if (s->top < 2) { m->halted = true; return; }
+    heap_object_t* map = find_map(m, s->elements[s->top]);
+    if (map == NULL) return;
+    size_t bytes = map_put_bytes(map, s->elements[s->top - 1]);
+    if (bytes > 0) {
+        collect_if_needed(m, bytes);
+        if (!heap_limit_allows(m, bytes)) {
+            halt_with(m, IJVM_HALT_HEAP_LIMIT);
+            return;
+        }
+        // A collection may have promoted, compacted or (for an untagged
+        // reference) freed the map
+        map = find_map(m, s->elements[s->top]);
+        if (map == NULL) return;
+    }
+    uint8_t key_tag = s->tags[s->top - 1];
+    uint8_t value_tag = s->tags[s->top - 2];
+    pop(s);
+    word key = pop(s);
+    word value = pop(s);
+    if (!map_put(m, map, key, key_tag, value, value_tag)) m->halted = true;
+}
+
+// ILOAD and ISTORE carry the reference tag along with the value
+static void load_local(ijvm* m, int i) {
+    int slot = m->lv_pointer + i;
+    push_tagged(m->stack, m->stack->elements[slot], m->stack->tags[slot]);
+}
+
+static void store_local(ijvm* m, int i) {
+    int slot = m->lv_pointer + i;
+    uint8_t tag = m->stack->tags[m->stack->top];
+    m->stack->elements[slot] = pop(m->stack);
+    m->stack->tags[slot] = tag;
+}
+
+static void increment_local(ijvm* m, int i, int8_t value) {
+    int slot = m->lv_pointer + i;
+    m->stack->elements[slot] += value;
+    m->stack->tags[slot] = 0;
+}
+
 void step(ijvm* m) 
 {
   if (finished(m)) return;
@@ -232,65 +627,162 @@ void step(ijvm* m)
         push(m->stack, get_constant(m, const_index));
         break;
     }
-    case OP_NEWARRAY: {
-        if (m->stack->top < 0) { m->halted = true; break; }
-        word count = pop(m->stack);
-        if (count < 0) { m->halted = true; break; }
-
-        if (m->heap_size >= m->heap_capacity) {
-            m->heap_capacity *= 2;
-            m->heap = realloc(m->heap, m->heap_capacity * sizeof(heap_object_t*));
+    case OP_NEWARRAY:
+        new_array_instruction(m, ATYPE_INT, m->program_counter - 1);
+        break;
+    case OP_NEWTARRAY: {
+        if (m->program_counter >= m->text_size) { m->halted = true; break; }
+        uint8_t type = m->text[m->program_counter++];
+        if (type != ATYPE_UBYTE && type != ATYPE_CHAR && type != ATYPE_BYTE
+            && type != ATYPE_SHORT && type != ATYPE_INT) {
+            m->halted = true;
+            break;
         }
-        heap_object_t* new_obj = malloc(sizeof(heap_object_t));
-        new_obj->size = count;
-        new_obj->data = (word*)malloc(count * sizeof(word));
-        memset(new_obj->data, 0, count * sizeof(word)); // Initialize to zero
-        new_obj->reference = m->next_ref++;
-        
-        m->heap[m->heap_size++] = new_obj;
-        push(m->stack, new_obj->reference);
+        new_array_instruction(m, type, m->program_counter - 2);
         break;
     }
     case OP_IALOAD: {
         if (m->stack->top < 1) { m->halted = true; break; }
         word arrayref = pop(m->stack);
         word index = pop(m->stack);
-        heap_object_t* obj = find_heap_object(m, arrayref);
-        if (obj == NULL || index < 0 || index >= obj->size) {
-            fprintf(m->out, "ERROR: Array index out of bounds.\n");
-            m->halted = true;
-            break;
-        }
-        push(m->stack, obj->data[index]);
+        heap_object_t* obj = array_element(m, arrayref, index, sizeof(word));
+        if (obj == NULL) break;
+        push_tagged(m->stack, obj->data[index], obj->tags ? obj->tags[index] : 0);
         break;
     }
     case OP_IASTORE: {
         if (m->stack->top < 2) { m->halted = true; break; }
+        uint8_t value_tag = m->stack->tags[m->stack->top - 2];
         word arrayref = pop(m->stack);
         word index = pop(m->stack);
         word value = pop(m->stack);
-        heap_object_t* obj = find_heap_object(m, arrayref);
-        if (obj == NULL || index < 0 || index >= obj->size) {
-            fprintf(m->out, "ERROR: Array index out of bounds.\n");
-            m->halted = true;
+        heap_object_t* obj = array_element(m, arrayref, index, sizeof(word));
+        if (obj == NULL) break;
+        if (value_tag && alloc_tags(m, obj) == NULL) { m->halted = true; break; }
+        rc_release_range(m, obj, index, 1);
+        obj->data[index] = value;
+        if (obj->tags) obj->tags[index] = value_tag;
+        rc_retain(m, value, value_tag);
+        write_barrier(m, obj, value, value_tag);
+        break;
+    }
+    case OP_BALOAD: {
+        if (m->stack->top < 1) { m->halted = true; break; }
+        word arrayref = pop(m->stack);
+        word index = pop(m->stack);
+        heap_object_t* obj = array_element(m, arrayref, index, 1);
+        if (obj == NULL) break;
+        uint8_t value = ((uint8_t*)obj->data)[index];
+        push(m->stack, obj->type == ATYPE_BYTE ? (word)(int8_t)value : (word)value);
+        break;
+    }
+    case OP_BASTORE: {
+        if (m->stack->top < 2) { m->halted = true; break; }
+        word arrayref = pop(m->stack);
+        word index = pop(m->stack);
+        word value = pop(m->stack);
+        heap_object_t* obj = array_element(m, arrayref, index, 1);
+        if (obj == NULL) break;
+        ((uint8_t*)obj->data)[index] = (uint8_t)value;
+        break;
+    }
+    case OP_SALOAD: {
+        if (m->stack->top < 1) { m->halted = true; break; }
+        word arrayref = pop(m->stack);
+        word index = pop(m->stack);
+        heap_object_t* obj = array_element(m, arrayref, index, 2);
+        if (obj == NULL) break;
+        uint16_t value = ((uint16_t*)obj->data)[index];
+        push(m->stack, obj->type == ATYPE_SHORT ? (word)(int16_t)value : (word)value);
+        break;
+    }
+    case OP_SASTORE: {
+        if (m->stack->top < 2) { m->halted = true; break; }
+        word arrayref = pop(m->stack);
+        word index = pop(m->stack);
+        word value = pop(m->stack);
+        heap_object_t* obj = array_element(m, arrayref, index, 2);
+        if (obj == NULL) break;
+        ((uint16_t*)obj->data)[index] = (uint16_t)value;
+        break;
+    }
+    case OP_ARRAYCOPY:
+        array_copy_instruction(m);
+        break;
+    case OP_ARRAYFILL:
+        array_fill_instruction(m);
+        break;
+    case OP_VECOP:
+        if (m->program_counter >= m->text_size) { m->halted = true; break; }
+        vector_op_instruction(m, m->text[m->program_counter++]);
+        break;
+    case OP_VECREDUCE:
+        if (m->program_counter >= m->text_size) { m->halted = true; break; }
+        vector_reduce_instruction(m, m->text[m->program_counter++]);
+        break;
+    case OP_NEWMAP: {
+        collect_if_needed(m, sizeof(hash_map_t));
+        if (m->options.limits.max_live_arrays > 0
+            && m->live_objects >= m->options.limits.max_live_arrays) {
+            halt_with(m, IJVM_HALT_ARRAY_LIMIT);
             break;
         }
-        obj->data[index] = value;
+        if (!heap_limit_allows(m, sizeof(hash_map_t))) {
+            halt_with(m, IJVM_HALT_HEAP_LIMIT);
+            break;
+        }
+        heap_object_t* map = new_map(m);
+        if (map == NULL) { m->halted = true; break; }
+        if (m->profile) profile_allocation(m, map, m->program_counter - 1);
+        push_tagged(m->stack, map->reference, 1);
+        break;
+    }
+    case OP_MAPGET: {
+        if (m->stack->top < 1) { m->halted = true; break; }
+        heap_object_t* map = find_map(m, pop(m->stack));
+        word key = pop(m->stack);
+        if (map == NULL) break;
+        word value = 0;
+        uint8_t value_tag = 0;
+        map_get(map, key, &value, &value_tag);
+        push_tagged(m->stack, value, value_tag);
+        break;
+    }
+    case OP_MAPPUT:
+        map_put_instruction(m);
+        break;
+    case OP_MAPREMOVE: {
+        if (m->stack->top < 1) { m->halted = true; break; }
+        heap_object_t* map = find_map(m, pop(m->stack));
+        word key = pop(m->stack);
+        if (map == NULL) break;
+        push(m->stack, map_remove(m, map, key) ? 1 : 0);
+        break;
+    }
+    case OP_MAPSIZE: {
+        if (m->stack->top < 0) { m->halted = true; break; }
+        heap_object_t* map = find_map(m, pop(m->stack));
+        if (map == NULL) break;
+        push(m->stack, map_of(map)->count);
         break;
     }
+    case OP_GC:
+        collect_garbage(m);
+        break;
     case OP_BIPUSH:
         if (m->program_counter >= m->text_size) { m->halted = true; break; }
         push(m->stack, (int8_t)m->text[m->program_counter++]);
         break;
     case OP_DUP:
         if (m->stack->top < 0) { m->halted = true; break; }
-        push(m->stack, tos(m));
+        push_tagged(m->stack, tos(m), m->stack->tags[m->stack->top]);
         break;
     case OP_GOTO: {
         if (m->program_counter + 1 >= m->text_size) { m->halted = true; break; }
         int16_t offset = read_int16(&m->text[m->program_counter]);
         int target_pc = (m->program_counter - 1) + offset;
         if (target_pc < 0 || (unsigned int)target_pc >= m->text_size) { m->halted = true; break; }
+        if (!charge_branch(m, offset)) break;
         m->program_counter = target_pc;
         break;
     }
@@ -312,6 +804,7 @@ void step(ijvm* m)
         if ((instruction == OP_IFEQ && val == 0) || (instruction == OP_IFLT && val < 0)) {
             int target_pc = (m->program_counter - 1) + offset;
             if (target_pc < 0 || (unsigned int)target_pc >= m->text_size) { m->halted = true; break; }
+            if (!charge_branch(m, offset)) break;
             m->program_counter = target_pc;
         } else {
             m->program_counter += 2;
@@ -327,6 +820,7 @@ void step(ijvm* m)
         if (val1 == val2) {
             int target_pc = (m->program_counter - 1) + offset;
             if (target_pc < 0 || (unsigned int)target_pc >= m->text_size) { m->halted = true; break; }
+            if (!charge_branch(m, offset)) break;
             m->program_counter = target_pc;
         } else {
             m->program_counter += 2;
@@ -337,13 +831,13 @@ void step(ijvm* m)
         if (m->program_counter + 1 >= m->text_size) { m->halted = true; break; }
         uint8_t var = m->text[m->program_counter++];
         int8_t val = m->text[m->program_counter++];
-        m->stack->elements[m->lv_pointer + var] += val;
+        increment_local(m, var, val);
         break;
     }
     case OP_ILOAD: {
         if (m->program_counter >= m->text_size) { m->halted = true; break; }
         uint8_t var = m->text[m->program_counter++];
-        push(m->stack, get_local_variable(m, var));
+        load_local(m, var);
         break;
     }
     case OP_INVOKEVIRTUAL: {
@@ -367,31 +861,33 @@ void step(ijvm* m)
 
         if (m->stack->top < (int)num_params - 1) { m->halted = true; break; }
         if (m->lv_pointer == 0) { m->halted = true; break; }
-
-        word temp_args[num_params];
-        for (int i = 0; i < num_params; i++) {
-            temp_args[num_params - 1 - i] = pop(m->stack);
-        }
+        if (!charge_instructions(m, 1)) break;
 
         int link_ptr_target = m->stack->elements[m->lv_pointer];
         word caller_ret_pc = m->stack->elements[link_ptr_target];
         word caller_old_lv = m->stack->elements[link_ptr_target + 1];
 
-        m->stack->top = m->lv_pointer - 1;
-
-        for (int i = 0; i < num_params; i++) {
-            push(m->stack, temp_args[i]);
+        // Slide the new arguments down over the current frame; the
+        // regions may overlap, so this has to be a memmove.
+        int args_start = m->stack->top - (num_params - 1);
+        int new_lv = m->lv_pointer;
+        if (num_params > 0 && args_start != new_lv) {
+            memmove(&m->stack->elements[new_lv], &m->stack->elements[args_start],
+                    num_params * sizeof(word));
+            memmove(&m->stack->tags[new_lv], &m->stack->tags[args_start], num_params);
         }
+        m->stack->top = new_lv + num_params - 1;
 
-        int new_lv = m->stack->top - (num_params - 1);
         int new_link_ptr_target = new_lv + num_params + num_locals;
 
-        for (int i = 0; i < num_locals; ++i) push(m->stack, 0);
+        push_zeros(m->stack, num_locals);
+        if (m->stack->overflowed) break;
 
         push(m->stack, caller_ret_pc);
         push(m->stack, caller_old_lv);
 
         m->stack->elements[new_lv] = new_link_ptr_target;
+        m->stack->tags[new_lv] = 0;
         m->lv_pointer = new_lv;
         m->program_counter = method_address + 4;
         break;
@@ -403,7 +899,7 @@ void step(ijvm* m)
         if (m->stack->top < 0) { m->halted = true; break; }
         if (m->program_counter >= m->text_size) { m->halted = true; break; }
         uint8_t var = m->text[m->program_counter++];
-        m->stack->elements[m->lv_pointer + var] = pop(m->stack);
+        store_local(m, var);
         break;
     }
     case OP_NOP: break;
@@ -413,10 +909,13 @@ void step(ijvm* m)
         break;
     case OP_SWAP: {
         if (m->stack->top < 1) { m->halted = true; break; }
-        word val1 = pop(m->stack);
-        word val2 = pop(m->stack);
-        push(m->stack, val1);
-        push(m->stack, val2);
+        int top = m->stack->top;
+        word val1 = m->stack->elements[top];
+        uint8_t tag1 = m->stack->tags[top];
+        m->stack->elements[top] = m->stack->elements[top - 1];
+        m->stack->tags[top] = m->stack->tags[top - 1];
+        m->stack->elements[top - 1] = val1;
+        m->stack->tags[top - 1] = tag1;
         break;
     }
     case OP_WIDE: {
@@ -427,18 +926,18 @@ void step(ijvm* m)
         m->program_counter += 2;
 
         if (wide_op == OP_ILOAD) {
-            push(m->stack, get_local_variable(m, index));
+            load_local(m, index);
         } else if (wide_op == OP_ISTORE) {
             if (m->stack->top < 0) { m->halted = true; break; }
-            m->stack->elements[m->lv_pointer + index] = pop(m->stack);
+            store_local(m, index);
         } else if (wide_op == OP_IINC) {
             if (m->program_counter >= m->text_size) { m->halted = true; break; }
             int8_t val = m->text[m->program_counter++];
-            m->stack->elements[m->lv_pointer + index] += val;
+            increment_local(m, index, val);
         } else { m->halted = true; }
         break;
     }
-    case OP_HALT: m->halted = true; break;
+    case OP_HALT: halt_with(m, IJVM_HALT_NORMAL); break;
     case OP_ERR:
         fprintf(m->out, "ERROR: An error occurred.\n");
         m->halted = true;
@@ -454,6 +953,9 @@ void step(ijvm* m)
     }
     default: m->halted = true; break;
   }
+
+  // push() cannot stop the machine itself, so a refused push is picked up here
+  if (m->stack->overflowed) halt_with(m, IJVM_HALT_STACK_LIMIT);
 }
 
 byte get_instruction(ijvm* m) 
@@ -501,3 +1003,32 @@ int get_call_stack_size(ijvm* m)
   count++; // For the main frame
   return count;
 }
+
+bool is_heap_freed(ijvm* m, word reference)
+{
+  return find_heap_object(m, reference) == NULL;
+}
+
+bool is_tos_reference(ijvm* m)
+{
+  if (m->stack->top < 0) return false;
+  return m->stack->tags[m->stack->top] != 0;
+}
+
+ijvm_halt_reason get_halt_reason(ijvm* m)
+{
+  if (m->halt_reason != IJVM_HALT_NONE) return m->halt_reason;
+  if (m->halted) return IJVM_HALT_ERROR;
+  if (m->program_counter >= m->text_size) return IJVM_HALT_NORMAL;
+  return IJVM_HALT_NONE;
+}
+
+size_t get_stack_committed_bytes(ijvm* m)
+{
+  return (size_t)m->stack->capacity * sizeof(word);
+}
+
+size_t get_stack_peak_bytes(ijvm* m)
+{
+  return (size_t)m->stack->peak_capacity * sizeof(word);
+}
@@ -0,0 +1,88 @@
+// For mmap and fstat, which strict C11 mode hides
+#define _DEFAULT_SOURCE
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "loader.h"
+#include "arena.h"
+#include "util.h"
+
+#define IJVM_MAGIC 0x1DEADFAD
+
+// Offsets of the header fields: magic, constant pool origin and size, then
+// the pool, text origin and size, and the text itself
+#define POOL_SIZE_OFFSET 8
+#define POOL_OFFSET 12
+#define TEXT_HEADER_BYTES 8
+
+// Validates the image and points m->text into it. The constant pool is
+// copied into the arena and byte-swapped.
+static bool parse_image(ijvm* m, byte* image, size_t size) {
+    if (size < POOL_OFFSET || read_uint32(image) != IJVM_MAGIC) return false;
+    uint32_t pool_size = read_uint32(image + POOL_SIZE_OFFSET);
+    if (pool_size > size - POOL_OFFSET) return false;
+    size_t text_header = POOL_OFFSET + (size_t)pool_size;
+    if (TEXT_HEADER_BYTES > size - text_header) return false;
+    uint32_t text_size = read_uint32(image + text_header + 4);
+    if (text_size > size - text_header - TEXT_HEADER_BYTES) return false;
+
+    m->constant_pool = arena_alloc(&m->arena, pool_size);
+    if (m->constant_pool == NULL) return false;
+    memcpy(m->constant_pool, image + POOL_OFFSET, pool_size);
+    for (uint32_t i = 0; i < pool_size / 4; i++) {
+        m->constant_pool[i] = (word)swap_uint32((uint32_t)m->constant_pool[i]);
+    }
+    m->constant_pool_size = pool_size;
+    m->text = image + text_header + TEXT_HEADER_BYTES;
+    m->text_size = text_size;
+    return true;
+}
+
+// Fallback for files that cannot be mapped: the whole file is read into
+// the arena in one go.
+static bool read_image(ijvm* m, const char* path) {
+    FILE* binary = fopen(path, "rb");
+    if (!binary) return false;
+    bool ok = false;
+    if (fseek(binary, 0, SEEK_END) == 0) {
+        long size = ftell(binary);
+        byte* image = size >= 0 ? arena_alloc(&m->arena, (size_t)size) : NULL;
+        if (image && fseek(binary, 0, SEEK_SET) == 0
+            && fread(image, 1, (size_t)size, binary) == (size_t)size) {
+            ok = parse_image(m, image, (size_t)size);
+        }
+    }
+    fclose(binary);
+    return ok;
+}
+
+bool load_binary(ijvm* m, const char* path) {
+    m->mapping = NULL;
+    m->mapping_bytes = 0;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    void* image = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        image = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (image == MAP_FAILED) return read_image(m, path);
+
+    m->mapping = image;
+    m->mapping_bytes = (size_t)st.st_size;
+    if (!parse_image(m, image, m->mapping_bytes)) {
+        unload_binary(m);
+        return false;
+    }
+    return true;
+}
+
+void unload_binary(ijvm* m) {
+    if (m->mapping) munmap(m->mapping, m->mapping_bytes);
+    m->mapping = NULL;
+    m->mapping_bytes = 0;
+}
@@ -0,0 +1,161 @@
+#include <stdlib.h>
+#include <string.h>
+#include "ijvm_ext.h"
+#include "heap.h"
+#include "profile.h"
+#include "util.h"
+
+heap_profile_t* create_heap_profile(void) {
+    heap_profile_t* profile = calloc(1, sizeof(heap_profile_t));
+    for (int i = 0; i < PROFILE_BUCKETS; i++) profile->buckets[i] = -1;
+    return profile;
+}
+
+void destroy_heap_profile(heap_profile_t* profile) {
+    if (profile == NULL) return;
+    for (int i = 0; i < profile->site_count; i++) {
+        free(profile->sites[i].frames);
+    }
+    free(profile->sites);
+    free(profile->slot_site);
+    free(profile->slot_birth);
+    free(profile->slot_bytes);
+    free(profile->scratch);
+    free(profile);
+}
+
+static int slot_of(heap_object_t* obj) {
+    return (int)((uint32_t)obj->reference & HANDLE_INDEX_MASK);
+}
+
+static void push_frame(heap_profile_t* profile, int depth, int method) {
+    if (depth >= profile->scratch_capacity) {
+        profile->scratch_capacity = profile->scratch_capacity == 0 ? 16 : profile->scratch_capacity * 2;
+        profile->scratch = realloc(profile->scratch, (size_t)profile->scratch_capacity * sizeof(int));
+    }
+    profile->scratch[depth] = method;
+}
+
+// Fills profile->scratch with the address of every active method, innermost
+// first, and returns how many there are. Each frame's saved pc points just
+// past the INVOKEVIRTUAL or TAILCALL that created it, whose operand names
+// the method; a tail-called method therefore shows up as the method whose
+// frame it took over.
+static int walk_frames(ijvm* m, heap_profile_t* profile) {
+    int depth = 0;
+    Stack* s = m->stack;
+    for (int lv = m->lv_pointer; lv > 0 && lv <= s->top;) {
+        // A program that tampers with its frames ends the walk early
+        int link = s->elements[lv];
+        if (link <= lv || link + 1 > s->top) break;
+        int saved_pc = s->elements[link];
+        int saved_lv = s->elements[link + 1];
+        if (saved_pc < 2 || (uint32_t)saved_pc > m->text_size || saved_lv >= lv) break;
+        uint16_t method_index = read_uint16(&m->text[saved_pc - 2]);
+        if (method_index >= m->constant_pool_size / 4) break;
+        push_frame(profile, depth++, get_constant(m, method_index));
+        lv = saved_lv;
+    }
+    return depth;
+}
+
+static uint32_t site_hash(const int* frames, int depth, int pc) {
+    uint32_t h = 2166136261u ^ (uint32_t)pc;
+    for (int i = 0; i < depth; i++) {
+        h = (h ^ (uint32_t)frames[i]) * 16777619u;
+    }
+    return h;
+}
+
+// Returns the index of the site for the current stack and `pc`, adding it
+// if it is new. The scratch frames are innermost first.
+static int find_site(heap_profile_t* profile, int depth, int pc) {
+    uint32_t hash = site_hash(profile->scratch, depth, pc);
+    int* bucket = &profile->buckets[hash % PROFILE_BUCKETS];
+    for (int i = *bucket; i >= 0; i = profile->sites[i].next) {
+        alloc_site_t* site = &profile->sites[i];
+        if (site->hash != hash || site->pc != pc || site->depth != depth) continue;
+        bool same = true;
+        for (int f = 0; f < depth && same; f++) {
+            same = site->frames[f] == profile->scratch[depth - 1 - f];
+        }
+        if (same) return i;
+    }
+
+    if (profile->site_count >= profile->site_capacity) {
+        profile->site_capacity = profile->site_capacity == 0 ? 16 : profile->site_capacity * 2;
+        profile->sites = realloc(profile->sites, (size_t)profile->site_capacity * sizeof(alloc_site_t));
+    }
+    int index = profile->site_count++;
+    alloc_site_t* site = &profile->sites[index];
+    memset(site, 0, sizeof(*site));
+    site->frames = malloc((size_t)(depth > 0 ? depth : 1) * sizeof(int));
+    for (int f = 0; f < depth; f++) {
+        site->frames[f] = profile->scratch[depth - 1 - f];
+    }
+    site->depth = depth;
+    site->pc = pc;
+    site->hash = hash;
+    site->next = *bucket;
+    *bucket = index;
+    return index;
+}
+
+static void ensure_slots(heap_profile_t* profile, int slot) {
+    if (slot < profile->slot_capacity) return;
+    int capacity = profile->slot_capacity == 0 ? 64 : profile->slot_capacity;
+    while (capacity <= slot) capacity *= 2;
+    profile->slot_site = realloc(profile->slot_site, (size_t)capacity * sizeof(int));
+    profile->slot_birth = realloc(profile->slot_birth, (size_t)capacity * sizeof(long long));
+    profile->slot_bytes = realloc(profile->slot_bytes, (size_t)capacity * sizeof(size_t));
+    profile->slot_capacity = capacity;
+}
+
+void profile_allocation(ijvm* m, heap_object_t* obj, int pc) {
+    heap_profile_t* profile = m->profile;
+    int site = find_site(profile, walk_frames(m, profile), pc);
+    int slot = slot_of(obj);
+    ensure_slots(profile, slot);
+    size_t bytes = array_data_bytes(obj->type, obj->size);
+    profile->slot_site[slot] = site;
+    profile->slot_birth[slot] = profile->clock++;
+    profile->slot_bytes[slot] = bytes;
+
+    alloc_site_t* s = &profile->sites[site];
+    s->allocations++;
+    s->live_objects++;
+    s->live_bytes += bytes;
+}
+
+void profile_free(ijvm* m, heap_object_t* obj) {
+    heap_profile_t* profile = m->profile;
+    int slot = slot_of(obj);
+    if (slot >= profile->slot_capacity) return;
+    alloc_site_t* s = &profile->sites[profile->slot_site[slot]];
+    s->frees++;
+    s->lifetime_total += profile->clock - profile->slot_birth[slot];
+    s->live_objects--;
+    s->live_bytes -= profile->slot_bytes[slot];
+}
+
+static void print_stack(FILE* out, const char* metric, alloc_site_t* site) {
+    fprintf(out, "%s;main", metric);
+    for (int f = 0; f < site->depth; f++) {
+        fprintf(out, ";method@0x%04x", (unsigned)site->frames[f]);
+    }
+    fprintf(out, ";alloc@0x%04x", (unsigned)site->pc);
+}
+
+void dump_heap_profile(ijvm* m, FILE* out) {
+    heap_profile_t* profile = m->profile;
+    if (profile == NULL) return;
+    for (int i = 0; i < profile->site_count; i++) {
+        alloc_site_t* site = &profile->sites[i];
+        print_stack(out, "live_bytes", site);
+        fprintf(out, " %zu\n", site->live_bytes);
+        print_stack(out, "allocations", site);
+        fprintf(out, " %lld\n", site->allocations);
+        print_stack(out, "avg_lifetime", site);
+        fprintf(out, " %lld\n", site->frees > 0 ? site->lifetime_total / site->frees : 0);
+    }
+}
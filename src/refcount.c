@@ -0,0 +1,133 @@
+#include <stdlib.h>
+#include "refcount.h"
+#include "hashmap.h"
+#include "heap.h"
+#include "ijvm_ext.h"
+
+static void zct_push(ijvm* m, heap_object_t* obj) {
+    if (m->zct_size >= m->zct_capacity) {
+        int capacity = m->zct_capacity == 0 ? 256 : m->zct_capacity * 2;
+        word* zct = realloc(m->zct, (size_t)capacity * sizeof(word));
+        // An object left off the table is still freed by the backup
+        // collection, which lists it again afterwards
+        if (zct == NULL) return;
+        m->zct = zct;
+        m->zct_capacity = capacity;
+    }
+    obj->zero_count = true;
+    m->zct[m->zct_size++] = obj->reference;
+}
+
+void rc_retain(ijvm* m, word value, uint8_t tag) {
+    if (!m->options.reference_counting || !tag) return;
+    heap_object_t* obj = find_heap_object(m, value);
+    if (obj) obj->refcount++;
+}
+
+void rc_release(ijvm* m, word value, uint8_t tag) {
+    if (!m->options.reference_counting || !tag) return;
+    heap_object_t* obj = find_heap_object(m, value);
+    if (obj == NULL || obj->refcount == 0) return;
+    if (--obj->refcount == 0 && !obj->zero_count) zct_push(m, obj);
+}
+
+void rc_retain_range(ijvm* m, heap_object_t* obj, int from, int count) {
+    if (!m->options.reference_counting || obj->tags == NULL) return;
+    for (int i = from; i < from + count; i++) rc_retain(m, obj->data[i], obj->tags[i]);
+}
+
+void rc_release_range(ijvm* m, heap_object_t* obj, int from, int count) {
+    if (!m->options.reference_counting || obj->tags == NULL) return;
+    for (int i = from; i < from + count; i++) rc_release(m, obj->data[i], obj->tags[i]);
+}
+
+void rc_track(ijvm* m, heap_object_t* obj) {
+    obj->refcount = 0;
+    obj->zero_count = false;
+    if (m->options.reference_counting) zct_push(m, obj);
+}
+
+// Drops the references `obj` holds, as it is about to be freed.
+static void release_children(ijvm* m, heap_object_t* obj) {
+    if (obj->type == TYPE_MAP) {
+        hash_map_t* map = map_of(obj);
+        for (int i = 0; i < map->capacity; i++) {
+            map_entry_t* e = &map->entries[i];
+            if (e->state != MAP_FULL) continue;
+            rc_release(m, e->key, e->key_tag);
+            rc_release(m, e->value, e->value_tag);
+        }
+    } else if (obj->type == ATYPE_INT) {
+        rc_release_range(m, obj, 0, obj->size);
+    }
+}
+
+// Sets or clears the mark of every object the stack refers to.
+static void mark_stack_roots(ijvm* m, bool marked) {
+    Stack* s = m->stack;
+    for (int i = 0; i <= s->top; i++) {
+        if (!s->tags[i]) continue;
+        heap_object_t* obj = find_heap_object(m, s->elements[i]);
+        if (obj) obj->marked = marked;
+    }
+}
+
+void reconcile_counts(ijvm* m) {
+    if (m->zct_size == 0) return;
+    mark_stack_roots(m, true);
+    // Entries still on the stack move to the front, [0, kept); the ones
+    // that remain to be looked at are [kept, zct_size). Freeing an object
+    // may list more at the end.
+    int kept = 0;
+    while (m->zct_size > kept) {
+        word ref = m->zct[--m->zct_size];
+        heap_object_t* obj = find_heap_object(m, ref);
+        // A full collection may have freed it since
+        if (obj == NULL) continue;
+        if (obj->refcount > 0) {
+            obj->zero_count = false;
+        } else if (obj->marked) {
+            m->zct[m->zct_size++] = m->zct[kept];
+            m->zct[kept++] = ref;
+        } else {
+            release_children(m, obj);
+            size_t bytes = object_bytes(obj->type, obj->size);
+            m->old_bytes_since_gc -= bytes < m->old_bytes_since_gc ? bytes : m->old_bytes_since_gc;
+            free_heap_object(m, obj);
+        }
+    }
+    mark_stack_roots(m, false);
+    m->zct_trigger = kept + m->options.rc_batch_objects;
+    m->reconciliations++;
+}
+
+void rebuild_counts(ijvm* m) {
+    if (!m->options.reference_counting) return;
+    m->zct_size = 0;
+    for (int i = 0; i < m->heap_size; i++) {
+        heap_object_t* obj = m->heap[i].object;
+        if (obj == NULL) continue;
+        obj->refcount = 0;
+        obj->zero_count = false;
+    }
+    for (int i = 0; i < m->heap_size; i++) {
+        heap_object_t* obj = m->heap[i].object;
+        if (obj == NULL) continue;
+        if (obj->type == TYPE_MAP) {
+            hash_map_t* map = map_of(obj);
+            for (int j = 0; j < map->capacity; j++) {
+                map_entry_t* e = &map->entries[j];
+                if (e->state != MAP_FULL) continue;
+                rc_retain(m, e->key, e->key_tag);
+                rc_retain(m, e->value, e->value_tag);
+            }
+        } else if (obj->type == ATYPE_INT) {
+            rc_retain_range(m, obj, 0, obj->size);
+        }
+    }
+    for (int i = 0; i < m->heap_size; i++) {
+        heap_object_t* obj = m->heap[i].object;
+        if (obj != NULL && obj->refcount == 0) zct_push(m, obj);
+    }
+    m->zct_trigger = m->zct_size + m->options.rc_batch_objects;
+}
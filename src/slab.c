@@ -0,0 +1,119 @@
+// For MAP_ANONYMOUS, which strict C11 mode hides
+#define _DEFAULT_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "slab.h"
+
+#if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+// Block sizes of the size classes, ending at SLAB_MAX_BLOCK
+static const size_t class_sizes[SLAB_CLASS_COUNT] = {
+    64, 96, 128, 192, 256, 384, 512, 768, 1024, 1536, 2048, 3072, 4096
+};
+
+// Chunks are linked through a header in front of their first block; its
+// size keeps the blocks 16-byte aligned.
+#define CHUNK_HEADER 16
+
+static int size_class(size_t bytes) {
+    for (int i = 0; i < SLAB_CLASS_COUNT; i++) {
+        if (bytes <= class_sizes[i]) return i;
+    }
+    return -1;
+}
+
+size_t slab_block_bytes(size_t bytes) {
+    int c = size_class(bytes);
+    return c < 0 ? 0 : class_sizes[c];
+}
+
+void init_slabs(slab_allocator_t* slabs, arena_t* arena) {
+    for (int i = 0; i < SLAB_CLASS_COUNT; i++) {
+        slabs->classes[i].free_list = NULL;
+        slabs->classes[i].bump = NULL;
+        slabs->classes[i].bump_end = NULL;
+    }
+    slabs->chunks = NULL;
+    slabs->committed = 0;
+    slabs->used = 0;
+    slabs->outside = 0;
+    slabs->arena = arena;
+}
+
+static void* map_block(slab_allocator_t* slabs, size_t bytes) {
+    void* block = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (block == MAP_FAILED) return NULL;
+    slabs->outside++;
+    return block;
+}
+
+void* slab_alloc(slab_allocator_t* slabs, size_t bytes) {
+    if (bytes >= LARGE_OBJECT_BYTES) return map_block(slabs, bytes);
+    int c = size_class(bytes);
+    if (c < 0) {
+        void* block = malloc(bytes);
+        if (block) slabs->outside++;
+        return block;
+    }
+
+    slab_class_t* sc = &slabs->classes[c];
+    slabs->used += class_sizes[c];
+    if (sc->free_list) {
+        void* block = sc->free_list;
+        sc->free_list = *(void**)block;
+        return block;
+    }
+    if (sc->bump == NULL || sc->bump + class_sizes[c] > sc->bump_end) {
+        byte* chunk = arena_region(slabs->arena);
+        if (chunk == NULL) {
+            slabs->used -= class_sizes[c];
+            return NULL;
+        }
+        *(void**)chunk = slabs->chunks;
+        slabs->chunks = chunk;
+        slabs->committed += SLAB_CHUNK_BYTES;
+        sc->bump = chunk + CHUNK_HEADER;
+        sc->bump_end = chunk + SLAB_CHUNK_BYTES;
+    }
+    void* block = sc->bump;
+    sc->bump += class_sizes[c];
+    return block;
+}
+
+void* slab_calloc(slab_allocator_t* slabs, size_t bytes) {
+    // Fresh mappings are already zero, without touching a single page
+    if (bytes >= LARGE_OBJECT_BYTES) return map_block(slabs, bytes);
+    void* block = slab_alloc(slabs, bytes);
+    if (block) memset(block, 0, bytes);
+    return block;
+}
+
+void slab_free(slab_allocator_t* slabs, void* block, size_t bytes) {
+    if (bytes >= LARGE_OBJECT_BYTES) {
+        munmap(block, bytes);
+        slabs->outside--;
+        return;
+    }
+    int c = size_class(bytes);
+    if (c < 0) {
+        free(block);
+        slabs->outside--;
+        return;
+    }
+    *(void**)block = slabs->classes[c].free_list;
+    slabs->classes[c].free_list = block;
+    slabs->used -= class_sizes[c];
+}
+
+void destroy_slabs(slab_allocator_t* slabs) {
+    void* chunk = slabs->chunks;
+    while (chunk) {
+        void* next = *(void**)chunk;
+        arena_free_region(slabs->arena, chunk);
+        chunk = next;
+    }
+    init_slabs(slabs, slabs->arena);
+}
@@ -0,0 +1,167 @@
+#include <stdint.h>
+#include "vector.h"
+
+#if defined(__x86_64__)
+#define VECTOR_X86 1
+#include <immintrin.h>
+#endif
+
+// Arithmetic goes through uint32_t so overflow wraps instead of being undefined
+static word wrap_add(word x, word y) { return (word)((uint32_t)x + (uint32_t)y); }
+static word wrap_sub(word x, word y) { return (word)((uint32_t)x - (uint32_t)y); }
+
+static void binary_scalar(int op, word* dst, const word* a, const word* b, int n) {
+    switch (op) {
+    case VEC_ADD: for (int i = 0; i < n; i++) dst[i] = wrap_add(a[i], b[i]); break;
+    case VEC_SUB: for (int i = 0; i < n; i++) dst[i] = wrap_sub(a[i], b[i]); break;
+    case VEC_AND: for (int i = 0; i < n; i++) dst[i] = a[i] & b[i]; break;
+    case VEC_OR:  for (int i = 0; i < n; i++) dst[i] = a[i] | b[i]; break;
+    default: break;
+    }
+}
+
+static word reduce_scalar(int op, const word* a, int n) {
+    word result;
+    switch (op) {
+    case VEC_SUM:
+        result = 0;
+        for (int i = 0; i < n; i++) result = wrap_add(result, a[i]);
+        return result;
+    case VEC_MIN:
+        result = INT32_MAX;
+        for (int i = 0; i < n; i++) if (a[i] < result) result = a[i];
+        return result;
+    case VEC_MAX:
+        result = INT32_MIN;
+        for (int i = 0; i < n; i++) if (a[i] > result) result = a[i];
+        return result;
+    default:
+        return 0;
+    }
+}
+
+#ifdef VECTOR_X86
+
+// Runs `body` over the vector-sized part of the range; the tail is left to
+// the scalar kernel.
+#define BINARY_LOOP(width, type, load, store, body)                          \
+    for (; i + (width) <= n; i += (width)) {                                 \
+        type x = load((const type*)(a + i));                                 \
+        type y = load((const type*)(b + i));                                 \
+        store((type*)(dst + i), body);                                       \
+    }
+
+static void binary_sse2(int op, word* dst, const word* a, const word* b, int n) {
+    int i = 0;
+    switch (op) {
+    case VEC_ADD: BINARY_LOOP(4, __m128i, _mm_loadu_si128, _mm_storeu_si128, _mm_add_epi32(x, y)) break;
+    case VEC_SUB: BINARY_LOOP(4, __m128i, _mm_loadu_si128, _mm_storeu_si128, _mm_sub_epi32(x, y)) break;
+    case VEC_AND: BINARY_LOOP(4, __m128i, _mm_loadu_si128, _mm_storeu_si128, _mm_and_si128(x, y)) break;
+    case VEC_OR:  BINARY_LOOP(4, __m128i, _mm_loadu_si128, _mm_storeu_si128, _mm_or_si128(x, y)) break;
+    default: return;
+    }
+    binary_scalar(op, dst + i, a + i, b + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static void binary_avx2(int op, word* dst, const word* a, const word* b, int n) {
+    int i = 0;
+    switch (op) {
+    case VEC_ADD: BINARY_LOOP(8, __m256i, _mm256_loadu_si256, _mm256_storeu_si256, _mm256_add_epi32(x, y)) break;
+    case VEC_SUB: BINARY_LOOP(8, __m256i, _mm256_loadu_si256, _mm256_storeu_si256, _mm256_sub_epi32(x, y)) break;
+    case VEC_AND: BINARY_LOOP(8, __m256i, _mm256_loadu_si256, _mm256_storeu_si256, _mm256_and_si256(x, y)) break;
+    case VEC_OR:  BINARY_LOOP(8, __m256i, _mm256_loadu_si256, _mm256_storeu_si256, _mm256_or_si256(x, y)) break;
+    default: return;
+    }
+    binary_scalar(op, dst + i, a + i, b + i, n - i);
+}
+
+// SSE2 has no 32-bit min/max, so select with a compare mask
+static __m128i select_sse2(__m128i mask, __m128i if_set, __m128i if_clear) {
+    return _mm_or_si128(_mm_and_si128(mask, if_set), _mm_andnot_si128(mask, if_clear));
+}
+
+static word reduce_sse2(int op, const word* a, int n) {
+    __m128i acc;
+    switch (op) {
+    case VEC_SUM: acc = _mm_setzero_si128(); break;
+    case VEC_MIN: acc = _mm_set1_epi32(INT32_MAX); break;
+    case VEC_MAX: acc = _mm_set1_epi32(INT32_MIN); break;
+    default: return 0;
+    }
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128i x = _mm_loadu_si128((const __m128i*)(a + i));
+        switch (op) {
+        case VEC_SUM: acc = _mm_add_epi32(acc, x); break;
+        case VEC_MIN: acc = select_sse2(_mm_cmpgt_epi32(acc, x), x, acc); break;
+        default:      acc = select_sse2(_mm_cmpgt_epi32(x, acc), x, acc); break;
+        }
+    }
+    word lanes[4];
+    _mm_storeu_si128((__m128i*)lanes, acc);
+    word result = reduce_scalar(op, lanes, 4);
+    word tail = reduce_scalar(op, a + i, n - i);
+    return reduce_scalar(op, (word[]){ result, tail }, 2);
+}
+
+__attribute__((target("avx2")))
+static word reduce_avx2(int op, const word* a, int n) {
+    __m256i acc;
+    switch (op) {
+    case VEC_SUM: acc = _mm256_setzero_si256(); break;
+    case VEC_MIN: acc = _mm256_set1_epi32(INT32_MAX); break;
+    case VEC_MAX: acc = _mm256_set1_epi32(INT32_MIN); break;
+    default: return 0;
+    }
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i x = _mm256_loadu_si256((const __m256i*)(a + i));
+        switch (op) {
+        case VEC_SUM: acc = _mm256_add_epi32(acc, x); break;
+        case VEC_MIN: acc = _mm256_min_epi32(acc, x); break;
+        default:      acc = _mm256_max_epi32(acc, x); break;
+        }
+    }
+    word lanes[8];
+    _mm256_storeu_si256((__m256i*)lanes, acc);
+    word result = reduce_scalar(op, lanes, 8);
+    word tail = reduce_scalar(op, a + i, n - i);
+    return reduce_scalar(op, (word[]){ result, tail }, 2);
+}
+
+#endif
+
+// 0 scalar, 1 SSE2, 2 AVX2
+static int simd_level(void) {
+    static int level = -1;
+    if (level < 0) {
+#ifdef VECTOR_X86
+        __builtin_cpu_init();
+        level = __builtin_cpu_supports("avx2") ? 2 : 1;
+#else
+        level = 0;
+#endif
+    }
+    return level;
+}
+
+void vector_binary(int op, word* dst, const word* a, const word* b, int n) {
+    switch (simd_level()) {
+#ifdef VECTOR_X86
+    case 2: binary_avx2(op, dst, a, b, n); break;
+    case 1: binary_sse2(op, dst, a, b, n); break;
+#endif
+    default: binary_scalar(op, dst, a, b, n); break;
+    }
+}
+
+word vector_reduce(int op, const word* a, int n) {
+    switch (simd_level()) {
+#ifdef VECTOR_X86
+    case 2: return reduce_avx2(op, a, n);
+    case 1: return reduce_sse2(op, a, n);
+#endif
+    default: return reduce_scalar(op, a, n);
+    }
+}
@@ -0,0 +1,179 @@
+#include <stdio.h>
+#include <string.h>
+#include "../include/ijvm.h"
+#include "../include/ijvm_ext.h"
+#include "testutil.h"
+#include "testprogram.h"
+
+static ijvm_halt_reason run_program(const byte_t *text, int text_size)
+{
+    FILE *output_file = tmpfile();
+    ijvm *m = init_program("test_bulk_arrays.ijvm", NULL, 0, text, text_size, NULL,
+                           output_file);
+    assert(m != NULL);
+    run(m);
+    ijvm_halt_reason reason = get_halt_reason(m);
+    destroy_ijvm(m);
+    fclose(output_file);
+    return reason;
+}
+
+/* fills and copies, including an overlapping copy, then prints both arrays */
+void test_copy_and_fill(void)
+{
+    byte_t text[] = {
+        OP_BIPUSH, 8,           // 0
+        OP_NEWARRAY,            // 2
+        OP_ISTORE, 0,           // 3: a
+        OP_BIPUSH, 8,           // 5
+        OP_NEWARRAY,            // 7
+        OP_ISTORE, 1,           // 8: b
+        OP_ILOAD, 0,            // 10
+        OP_BIPUSH, 0,           // 12
+        OP_BIPUSH, 8,           // 14
+        OP_BIPUSH, 7,           // 16
+        OP_ARRAYFILL,           // 18: a = 77777777
+        OP_ILOAD, 0,            // 19
+        OP_BIPUSH, 2,           // 21
+        OP_BIPUSH, 3,           // 23
+        OP_BIPUSH, 9,           // 25
+        OP_ARRAYFILL,           // 27: a = 77999777
+        OP_ILOAD, 0,            // 28
+        OP_BIPUSH, 1,           // 30
+        OP_ILOAD, 1,            // 32
+        OP_BIPUSH, 4,           // 34
+        OP_BIPUSH, 4,           // 36
+        OP_ARRAYCOPY,           // 38: b = 00007999
+        OP_ILOAD, 0,            // 39
+        OP_BIPUSH, 0,           // 41
+        OP_ILOAD, 0,            // 43
+        OP_BIPUSH, 1,           // 45
+        OP_BIPUSH, 7,           // 47
+        OP_ARRAYCOPY,           // 49: a = 77799977
+        OP_ILOAD, 2,            // 50: print a
+        OP_BIPUSH, 8,           // 52
+        OP_IF_ICMPEQ, 0x00, 0x12, // 54
+        OP_BIPUSH, '0',         // 57
+        OP_ILOAD, 2,            // 59
+        OP_ILOAD, 0,            // 61
+        OP_IALOAD,              // 63
+        OP_IADD,                // 64
+        OP_OUT,                 // 65
+        OP_IINC, 2, 1,          // 66
+        OP_GOTO, 0xFF, 0xED,    // 69
+        OP_BIPUSH, 0,           // 72
+        OP_ISTORE, 2,           // 74
+        OP_ILOAD, 2,            // 76: print b
+        OP_BIPUSH, 8,           // 78
+        OP_IF_ICMPEQ, 0x00, 0x12, // 80
+        OP_BIPUSH, '0',         // 83
+        OP_ILOAD, 2,            // 85
+        OP_ILOAD, 1,            // 87
+        OP_IALOAD,              // 89
+        OP_IADD,                // 90
+        OP_OUT,                 // 91
+        OP_IINC, 2, 1,          // 92
+        OP_GOTO, 0xFF, 0xED,    // 95
+        OP_HALT                 // 98
+    };
+    FILE *output_file = tmpfile();
+    ijvm *m = init_program("test_copy_and_fill.ijvm", NULL, 0, text, sizeof(text), NULL,
+                           output_file);
+    assert(m != NULL);
+    run(m);
+    assert(get_halt_reason(m) == IJVM_HALT_NORMAL);
+
+    char buf[32] = {0};
+    rewind(output_file);
+    assert(fread(buf, 1, sizeof(buf) - 1, output_file) == 16);
+    assert(strcmp(buf, "7779997700007999") == 0);
+
+    destroy_ijvm(m);
+    fclose(output_file);
+}
+
+/* ranges outside the array and copies between widths are errors */
+void test_bad_ranges(void)
+{
+    byte_t copy_past_end[] = {
+        OP_BIPUSH, 4, OP_NEWARRAY, OP_ISTORE, 0,
+        OP_ILOAD, 0, OP_BIPUSH, 2, OP_ILOAD, 0, OP_BIPUSH, 0, OP_BIPUSH, 3, OP_ARRAYCOPY,
+        OP_HALT
+    };
+    assert(run_program(copy_past_end, sizeof(copy_past_end)) == IJVM_HALT_ERROR);
+
+    byte_t fill_negative[] = {
+        OP_BIPUSH, 4, OP_NEWARRAY, OP_BIPUSH, 0xFF, OP_BIPUSH, 2, OP_BIPUSH, 5, OP_ARRAYFILL,
+        OP_HALT
+    };
+    assert(run_program(fill_negative, sizeof(fill_negative)) == IJVM_HALT_ERROR);
+
+    byte_t fill_empty_at_end[] = {
+        OP_BIPUSH, 4, OP_NEWARRAY, OP_BIPUSH, 4, OP_BIPUSH, 0, OP_BIPUSH, 5, OP_ARRAYFILL,
+        OP_HALT
+    };
+    assert(run_program(fill_empty_at_end, sizeof(fill_empty_at_end)) == IJVM_HALT_NORMAL);
+
+    byte_t copy_across_widths[] = {
+        OP_BIPUSH, 4, OP_NEWTARRAY, ATYPE_BYTE, OP_BIPUSH, 0,
+        OP_BIPUSH, 4, OP_NEWARRAY, OP_BIPUSH, 0, OP_BIPUSH, 1, OP_ARRAYCOPY,
+        OP_HALT
+    };
+    assert(run_program(copy_across_widths, sizeof(copy_across_widths)) == IJVM_HALT_ERROR);
+}
+
+/* copied references keep their tags, so the collector still follows them */
+void test_copy_keeps_references(void)
+{
+    byte_t text[] = {
+        OP_BIPUSH, 1,           // 0
+        OP_NEWARRAY,            // 2
+        OP_ISTORE, 0,           // 3: src
+        OP_BIPUSH, 1,           // 5
+        OP_NEWARRAY,            // 7
+        OP_ISTORE, 1,           // 8: dst
+        OP_BIPUSH, 3,           // 10
+        OP_NEWARRAY,            // 12
+        OP_BIPUSH, 0,           // 13
+        OP_ILOAD, 0,            // 15
+        OP_IASTORE,             // 17: src[0] = inner
+        OP_ILOAD, 0,            // 18
+        OP_BIPUSH, 0,           // 20
+        OP_ILOAD, 1,            // 22
+        OP_BIPUSH, 0,           // 24
+        OP_BIPUSH, 1,           // 26
+        OP_ARRAYCOPY,           // 28: dst[0] = src[0]
+        OP_BIPUSH, 0,           // 29
+        OP_BIPUSH, 0,           // 31
+        OP_ILOAD, 0,            // 33
+        OP_IASTORE,             // 35: src[0] = 0
+        OP_GC,                  // 36
+        OP_BIPUSH, 0,           // 37
+        OP_ILOAD, 1,            // 39
+        OP_IALOAD,              // 41
+        OP_HALT                 // 42
+    };
+    FILE *output_file = tmpfile();
+    ijvm *m = init_program("test_copy_keeps_references.ijvm", NULL, 0, text, sizeof(text),
+                           NULL, output_file);
+    assert(m != NULL);
+
+    run_until(m, 13);
+    word inner = tos(m);
+    run_until(m, 37);
+    assert(!is_heap_freed(m, inner));
+    run(m);
+    assert(tos(m) == inner);
+    assert(is_tos_reference(m));
+
+    destroy_ijvm(m);
+    fclose(output_file);
+}
+
+int main(void)
+{
+    RUN_TEST(test_copy_and_fill);
+    RUN_TEST(test_bad_ranges);
+    RUN_TEST(test_copy_keeps_references);
+    return END_TEST();
+}
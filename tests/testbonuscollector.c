@@ -0,0 +1,611 @@
+#include <stdio.h>
+#include "../include/ijvm.h"
+#include "../include/ijvm_ext.h"
+#include "testutil.h"
+#include "testprogram.h"
+
+/* a reference to a freed array stays invalid after its handle is reused */
+void test_stale_reference(void)
+{
+    byte_t text[] = {
+        OP_BIPUSH, 4,           // 0
+        OP_NEWARRAY,            // 2
+        OP_DUP,                 // 3
+        OP_ISTORE, 0,           // 4
+        OP_BIPUSH, 0,           // 6
+        OP_IADD,                // 8: an untagged copy of the reference
+        OP_ISTORE, 1,           // 9
+        OP_BIPUSH, 0,           // 11
+        OP_ISTORE, 0,           // 13
+        OP_GC,                  // 15
+        OP_BIPUSH, 4,           // 16
+        OP_NEWARRAY,            // 18
+        OP_ISTORE, 2,           // 19
+        OP_BIPUSH, 0,           // 21
+        OP_ILOAD, 1,            // 23
+        OP_IALOAD,              // 25
+        OP_HALT                 // 26
+    };
+    FILE *output_file = tmpfile();
+    ijvm *m = init_program("test_stale_reference.ijvm", NULL, 0, text, sizeof(text),
+                           NULL, output_file);
+    assert(m != NULL);
+
+    run_until(m, 15);
+    word ref1 = get_local_variable(m, 1);
+    assert(!is_heap_freed(m, ref1));
+    step(m);
+    assert(is_heap_freed(m, ref1));
+
+    run_until(m, 21);
+    word ref2 = get_local_variable(m, 2);
+    assert((ref2 & 0xFFFFFF) == (ref1 & 0xFFFFFF));
+    assert(ref2 != ref1);
+    assert(is_heap_freed(m, ref1));
+    assert(!is_heap_freed(m, ref2));
+
+    run(m);
+    assert(get_halt_reason(m) == IJVM_HALT_ERROR);
+
+    destroy_ijvm(m);
+    fclose(output_file);
+}
+
+/* the collector frees unreachable arrays and keeps everything reachable */
+void test_free_garbage_keep_live(void)
+{
+    byte_t text[] = {
+        OP_BIPUSH, 2,           // 0
+        OP_NEWARRAY,            // 2
+        OP_ISTORE, 0,           // 3: outer
+        OP_BIPUSH, 3,           // 5
+        OP_NEWARRAY,            // 7
+        OP_ISTORE, 1,           // 8: inner
+        OP_BIPUSH, 42,          // 10
+        OP_BIPUSH, 2,           // 12
+        OP_ILOAD, 1,            // 14
+        OP_IASTORE,             // 16: inner[2] = 42
+        OP_ILOAD, 1,            // 17
+        OP_BIPUSH, 0,           // 19
+        OP_ILOAD, 0,            // 21
+        OP_IASTORE,             // 23: outer[0] = inner
+        OP_BIPUSH, 0,           // 24
+        OP_ISTORE, 1,           // 26
+        OP_BIPUSH, 5,           // 28
+        OP_NEWARRAY,            // 30
+        OP_ISTORE, 2,           // 31
+        OP_BIPUSH, 0,           // 33
+        OP_ISTORE, 2,           // 35
+        OP_GC,                  // 37
+        OP_BIPUSH, 2,           // 38
+        OP_BIPUSH, 0,           // 40
+        OP_ILOAD, 0,            // 42
+        OP_IALOAD,              // 44: outer[0]
+        OP_IALOAD,              // 45: inner[2]
+        OP_HALT                 // 46
+    };
+    FILE *output_file = tmpfile();
+    ijvm *m = init_program("test_free_garbage_keep_live.ijvm", NULL, 0, text, sizeof(text),
+                           NULL, output_file);
+    assert(m != NULL);
+
+    run_until(m, 24);
+    word outer = get_local_variable(m, 0);
+    word inner = get_local_variable(m, 1);
+    run_until(m, 33);
+    word garbage = get_local_variable(m, 2);
+    run_until(m, 38);
+    assert(is_heap_freed(m, garbage));
+    assert(!is_heap_freed(m, outer));
+    assert(!is_heap_freed(m, inner));
+
+    run(m);
+    assert(tos(m) == 42);
+    assert(get_halt_reason(m) == IJVM_HALT_NORMAL);
+
+    destroy_ijvm(m);
+    fclose(output_file);
+}
+
+static ijvm_halt_reason run_limited(byte_t *text, int text_size, const word_t *constants,
+                                    int constant_count, const ijvm_options *opts)
+{
+    FILE *output_file = tmpfile();
+    ijvm *m = init_program("test_limits.ijvm", constants, constant_count, text, text_size,
+                           opts, output_file);
+    assert(m != NULL);
+    run(m);
+    ijvm_halt_reason reason = get_halt_reason(m);
+    destroy_ijvm(m);
+    fclose(output_file);
+    return reason;
+}
+
+/* every budget stops the machine with its own halt reason */
+void test_limits(void)
+{
+    ijvm_options opts;
+
+    byte_t push_forever[] = { OP_BIPUSH, 1, OP_GOTO, 0xFF, 0xFE };
+    default_ijvm_options(&opts);
+    opts.main_frame_slots = 16;
+    opts.limits.max_stack_words = 64;
+    assert(run_limited(push_forever, sizeof(push_forever), NULL, 0, &opts)
+           == IJVM_HALT_STACK_LIMIT);
+
+    // A main frame that does not fit is refused before the first step
+    byte_t halt[] = { OP_HALT };
+    default_ijvm_options(&opts);
+    opts.main_frame_slots = 128;
+    opts.limits.max_stack_words = 64;
+    assert(run_limited(halt, sizeof(halt), NULL, 0, &opts) == IJVM_HALT_STACK_LIMIT);
+
+    byte_t spin[] = { OP_GOTO, 0x00, 0x00 };
+    default_ijvm_options(&opts);
+    opts.limits.max_instructions = 1000;
+    assert(run_limited(spin, sizeof(spin), NULL, 0, &opts) == IJVM_HALT_INSTRUCTION_LIMIT);
+
+    word_t big[] = { 100000 };
+    byte_t alloc_big[] = { OP_LDC_W, 0x00, 0x00, OP_NEWARRAY, OP_HALT };
+    default_ijvm_options(&opts);
+    opts.limits.max_heap_bytes = 4096;
+    assert(run_limited(alloc_big, sizeof(alloc_big), big, 1, &opts) == IJVM_HALT_HEAP_LIMIT);
+
+    byte_t alloc_three[] = {
+        OP_BIPUSH, 1, OP_NEWARRAY, OP_BIPUSH, 1, OP_NEWARRAY, OP_BIPUSH, 1, OP_NEWARRAY, OP_HALT
+    };
+    default_ijvm_options(&opts);
+    opts.limits.max_live_arrays = 2;
+    assert(run_limited(alloc_three, sizeof(alloc_three), NULL, 0, &opts)
+           == IJVM_HALT_ARRAY_LIMIT);
+}
+
+/* TAILCALL computes the same result as INVOKEVIRTUAL in less stack */
+void test_tailcall_result(void)
+{
+    // sum(n, acc) = n == 0 ? acc : sum(n - 1, acc + n)
+    word_t constants[] = { 11, 10000 };
+    byte_t text[] = {
+        OP_BIPUSH, 0,           // 0
+        OP_LDC_W, 0x00, 0x01,   // 2
+        OP_BIPUSH, 0,           // 5
+        OP_INVOKEVIRTUAL, 0x00, 0x00, // 7
+        OP_HALT,                // 10
+        0x00, 0x03, 0x00, 0x00, // 11: sum
+        OP_ILOAD, 1,            // 15
+        OP_IFEQ, 0x00, 0x13,    // 17
+        OP_BIPUSH, 0,           // 20
+        OP_ILOAD, 1,            // 22
+        OP_BIPUSH, 1,           // 24
+        OP_ISUB,                // 26
+        OP_ILOAD, 2,            // 27
+        OP_ILOAD, 1,            // 29
+        OP_IADD,                // 31
+        OP_TAILCALL, 0x00, 0x00, // 32
+        OP_IRETURN,             // 35
+        OP_ILOAD, 2,            // 36
+        OP_IRETURN              // 38
+    };
+    FILE *output_file = tmpfile();
+    ijvm *m = init_program("test_tailcall_result.ijvm", constants, 2, text, sizeof(text),
+                           NULL, output_file);
+    assert(m != NULL);
+    run(m);
+    assert(tos(m) == 50005000);
+    assert(get_halt_reason(m) == IJVM_HALT_NORMAL);
+    size_t tail_peak = get_stack_peak_bytes(m);
+    destroy_ijvm(m);
+
+    text[32] = OP_INVOKEVIRTUAL;
+    m = init_program("test_tailcall_result.ijvm", constants, 2, text, sizeof(text),
+                     NULL, output_file);
+    assert(m != NULL);
+    run(m);
+    assert(tos(m) == 50005000);
+    assert(get_halt_reason(m) == IJVM_HALT_NORMAL);
+    assert(tail_peak < get_stack_peak_bytes(m));
+    destroy_ijvm(m);
+    fclose(output_file);
+}
+
+/* compacting the old space keeps every live array and its contents */
+void test_compaction_keeps_contents(void)
+{
+    byte_t text[] = {
+        OP_BIPUSH, 64,          // 0
+        OP_NEWARRAY,            // 2
+        OP_ISTORE, 0,           // 3: outer
+        OP_ILOAD, 1,            // 5: fill loop
+        OP_BIPUSH, 64,          // 7
+        OP_IF_ICMPEQ, 0x00, 0x20, // 9
+        OP_BIPUSH, 8,           // 12
+        OP_NEWARRAY,            // 14
+        OP_POP,                 // 15: garbage between the live arrays
+        OP_BIPUSH, 8,           // 16
+        OP_NEWARRAY,            // 18
+        OP_ISTORE, 2,           // 19
+        OP_ILOAD, 1,            // 21
+        OP_BIPUSH, 7,           // 23
+        OP_ILOAD, 2,            // 25
+        OP_IASTORE,             // 27: inner[7] = i
+        OP_ILOAD, 2,            // 28
+        OP_ILOAD, 1,            // 30
+        OP_ILOAD, 0,            // 32
+        OP_IASTORE,             // 34: outer[i] = inner
+        OP_IINC, 1, 1,          // 35
+        OP_GOTO, 0xFF, 0xDF,    // 38
+        OP_BIPUSH, 0,           // 41
+        OP_ISTORE, 1,           // 43
+        OP_BIPUSH, 0,           // 45
+        OP_ISTORE, 2,           // 47: sum
+        OP_ILOAD, 1,            // 49: sum loop
+        OP_BIPUSH, 64,          // 51
+        OP_IF_ICMPEQ, 0x00, 0x16, // 53
+        OP_ILOAD, 2,            // 56
+        OP_BIPUSH, 7,           // 58
+        OP_ILOAD, 1,            // 60
+        OP_ILOAD, 0,            // 62
+        OP_IALOAD,              // 64
+        OP_IALOAD,              // 65
+        OP_IADD,                // 66
+        OP_ISTORE, 2,           // 67
+        OP_IINC, 1, 1,          // 69
+        OP_GOTO, 0xFF, 0xE9,    // 72
+        OP_ILOAD, 2,            // 75
+        OP_HALT                 // 77
+    };
+    ijvm_options opts;
+    default_ijvm_options(&opts);
+    opts.nursery_bytes = 0;
+    FILE *output_file = tmpfile();
+    ijvm *m = init_program("test_compaction_keeps_contents.ijvm", NULL, 0, text,
+                           sizeof(text), &opts, output_file);
+    assert(m != NULL);
+
+    run_until(m, 41);
+    word outer = get_local_variable(m, 0);
+    compact_heap(m);
+    heap_stats stats;
+    get_heap_stats(m, &stats);
+    assert(stats.live_objects == 65);
+    assert(!is_heap_freed(m, outer));
+
+    run(m);
+    assert(tos(m) == 2016);
+    assert(get_halt_reason(m) == IJVM_HALT_NORMAL);
+
+    destroy_ijvm(m);
+    fclose(output_file);
+}
+
+/* churning through generations does not grow the handle table for good */
+void test_handle_slots_recycled(void)
+{
+    word_t constants[] = { 600000 };
+    byte_t text[] = {
+        OP_BIPUSH, 1,           // 0
+        OP_NEWARRAY,            // 2
+        OP_BIPUSH, 0,           // 3
+        OP_IADD,                // 5
+        OP_ISTORE, 1,           // 6: an untagged copy, soon stale
+        OP_ILOAD, 2,            // 8: churn loop
+        OP_LDC_W, 0x00, 0x00,   // 10
+        OP_IF_ICMPEQ, 0x00, 0x0D, // 13
+        OP_BIPUSH, 1,           // 16
+        OP_NEWARRAY,            // 18
+        OP_POP,                 // 19
+        OP_IINC, 2, 1,          // 20
+        OP_GOTO, 0xFF, 0xF1,    // 23
+        OP_BIPUSH, 0,           // 26
+        OP_ILOAD, 1,            // 28
+        OP_IALOAD,              // 30
+        OP_HALT                 // 31
+    };
+    FILE *output_file = tmpfile();
+    ijvm *m = init_program("test_handle_slots_recycled.ijvm", constants, 1, text,
+                           sizeof(text), NULL, output_file);
+    assert(m != NULL);
+
+    run_until(m, 8);
+    word stale = get_local_variable(m, 1);
+    run_until(m, 26);
+    heap_stats stats;
+    get_heap_stats(m, &stats);
+    // Without recycling, about one slot per 127 allocations is lost
+    assert(stats.heap_size <= 2048);
+    // The copy pins its slot, so it can never resolve to a new array
+    assert(is_heap_freed(m, stale));
+    run(m);
+    assert(get_halt_reason(m) == IJVM_HALT_ERROR);
+
+    destroy_ijvm(m);
+    fclose(output_file);
+}
+
+/* a table that is mostly live grows instead of being collected every few allocations */
+void test_handle_table_grows_with_live_set(void)
+{
+    word_t constants[] = { 1019, 20000 };
+    byte_t text[] = {
+        OP_LDC_W, 0x00, 0x00,   // 0
+        OP_NEWARRAY,            // 3
+        OP_ISTORE, 0,           // 4: outer
+        OP_ILOAD, 1,            // 6: fill loop
+        OP_LDC_W, 0x00, 0x00,   // 8
+        OP_IF_ICMPEQ, 0x00, 0x11, // 11
+        OP_BIPUSH, 1,           // 14
+        OP_NEWARRAY,            // 16
+        OP_ILOAD, 1,            // 17
+        OP_ILOAD, 0,            // 19
+        OP_IASTORE,             // 21: outer[i] = new array
+        OP_IINC, 1, 1,          // 22
+        OP_GOTO, 0xFF, 0xED,    // 25
+        OP_ILOAD, 2,            // 28: churn loop
+        OP_LDC_W, 0x00, 0x01,   // 30
+        OP_IF_ICMPEQ, 0x00, 0x0D, // 33
+        OP_BIPUSH, 1,           // 36
+        OP_NEWARRAY,            // 38
+        OP_POP,                 // 39
+        OP_IINC, 2, 1,          // 40
+        OP_GOTO, 0xFF, 0xF1,    // 43
+        OP_HALT                 // 46
+    };
+    // Without a nursery every collection is a full one
+    ijvm_options opts;
+    default_ijvm_options(&opts);
+    opts.nursery_bytes = 0;
+    FILE *output_file = tmpfile();
+    ijvm *m = init_program("test_handle_table_grows.ijvm", constants, 2, text, sizeof(text),
+                           &opts, output_file);
+    assert(m != NULL);
+
+    heap_stats before, after;
+    run_until(m, 28);
+    get_heap_stats(m, &before);
+    run(m);
+    assert(get_halt_reason(m) == IJVM_HALT_NORMAL);
+    get_heap_stats(m, &after);
+    long long collections = after.minor_collections - before.minor_collections
+        + after.full_collections - before.full_collections;
+    // One per table's worth of garbage, not one every few allocations
+    assert(collections <= 40);
+
+    destroy_ijvm(m);
+    fclose(output_file);
+}
+
+/* runs a program that keeps a chain of 50 arrays alive while it churns */
+static void run_incremental(int slice_objects, heap_stats *stats)
+{
+    word_t constants[] = { 2000 };
+    byte_t text[] = {
+        OP_BIPUSH, 1,           // 0
+        OP_NEWARRAY,            // 2
+        OP_ISTORE, 0,           // 3: holder
+        OP_ILOAD, 5,            // 5: chain loop
+        OP_BIPUSH, 50,          // 7
+        OP_IF_ICMPEQ, 0x00, 0x14, // 9
+        OP_ILOAD, 4,            // 12
+        OP_BIPUSH, 0,           // 14
+        OP_BIPUSH, 1,           // 16
+        OP_NEWARRAY,            // 18
+        OP_DUP,                 // 19
+        OP_ISTORE, 4,           // 20
+        OP_IASTORE,             // 22: link[0] = previous link
+        OP_IINC, 5, 1,          // 23
+        OP_GOTO, 0xFF, 0xEB,    // 26
+        OP_ILOAD, 1,            // 29: churn loop
+        OP_LDC_W, 0x00, 0x00,   // 31
+        OP_IF_ICMPEQ, 0x00, 0x24, // 34
+        OP_BIPUSH, 1,           // 37
+        OP_NEWARRAY,            // 39
+        OP_ISTORE, 2,           // 40
+        OP_ILOAD, 1,            // 42
+        OP_BIPUSH, 0,           // 44
+        OP_ILOAD, 2,            // 46
+        OP_IASTORE,             // 48: box[0] = i
+        OP_ILOAD, 2,            // 49
+        OP_BIPUSH, 0,           // 51
+        OP_ILOAD, 0,            // 53
+        OP_IASTORE,             // 55: holder[0] = box
+        OP_BIPUSH, 0,           // 56
+        OP_ISTORE, 2,           // 58
+        OP_BIPUSH, 8,           // 60
+        OP_NEWARRAY,            // 62
+        OP_POP,                 // 63: garbage
+        OP_IINC, 1, 1,          // 64
+        OP_GOTO, 0xFF, 0xDA,    // 67
+        OP_BIPUSH, 0,           // 70
+        OP_ILOAD, 0,            // 72
+        OP_IALOAD,              // 74
+        OP_ISTORE, 2,           // 75
+        OP_BIPUSH, 0,           // 77
+        OP_ILOAD, 2,            // 79
+        OP_IALOAD,              // 81: holder[0][0]
+        OP_ISTORE, 3,           // 82
+        OP_HALT                 // 84
+    };
+    // Without a nursery every allocation counts towards the next cycle
+    ijvm_options opts;
+    default_ijvm_options(&opts);
+    opts.nursery_bytes = 0;
+    opts.incremental_gc = true;
+    opts.gc_slice_objects = slice_objects;
+    opts.gc_min_trigger_bytes = 1024;
+    FILE *output_file = tmpfile();
+    ijvm *m = init_program("test_incremental_slices.ijvm", constants, 1, text, sizeof(text),
+                           &opts, output_file);
+    assert(m != NULL);
+
+    run_until(m, 23);
+    word last_link = get_local_variable(m, 4);
+    run_until(m, 63);
+    word garbage = tos(m);
+    run(m);
+    assert(get_halt_reason(m) == IJVM_HALT_NORMAL);
+    assert(get_local_variable(m, 3) == 1999);
+    assert(!is_heap_freed(m, last_link));
+    assert(is_heap_freed(m, garbage));
+    get_heap_stats(m, stats);
+
+    destroy_ijvm(m);
+    fclose(output_file);
+}
+
+/* a cycle over the chain takes a pause per object with a budget of one */
+void test_incremental_slices(void)
+{
+    heap_stats one, unbounded;
+    run_incremental(1, &one);
+    run_incremental(1000000, &unbounded);
+    assert(one.incremental_cycles > 0);
+    assert(one.full_collections == 0);
+    assert(one.pauses > 20 * one.incremental_cycles);
+    // The root scan and one slice that finishes the cycle
+    assert(unbounded.incremental_cycles > 0);
+    assert(unbounded.pauses <= 3 * unbounded.incremental_cycles);
+}
+
+/* swept arrays are freed at once but their memory is released in batches */
+void test_lazy_release(void)
+{
+    word_t constants[] = { 500 };
+    byte_t text[] = {
+        OP_BIPUSH, 100,         // 0
+        OP_NEWARRAY,            // 2
+        OP_ISTORE, 0,           // 3: outer
+        OP_ILOAD, 1,            // 5: fill loop
+        OP_BIPUSH, 100,         // 7
+        OP_IF_ICMPEQ, 0x00, 0x11, // 9
+        OP_BIPUSH, 4,           // 12
+        OP_NEWARRAY,            // 14
+        OP_ILOAD, 1,            // 15
+        OP_ILOAD, 0,            // 17
+        OP_IASTORE,             // 19: outer[i] = new array
+        OP_IINC, 1, 1,          // 20
+        OP_GOTO, 0xFF, 0xEE,    // 23
+        OP_GC,                  // 26: promotes them all
+        OP_BIPUSH, 0,           // 27
+        OP_ISTORE, 0,           // 29
+        OP_GC,                  // 31: retires them all
+        OP_ILOAD, 2,            // 32: churn loop, nursery only
+        OP_LDC_W, 0x00, 0x00,   // 34
+        OP_IF_ICMPEQ, 0x00, 0x0D, // 37
+        OP_BIPUSH, 4,           // 40
+        OP_NEWARRAY,            // 42
+        OP_POP,                 // 43
+        OP_IINC, 2, 1,          // 44
+        OP_GOTO, 0xFF, 0xF1,    // 47
+        OP_GC,                  // 50
+        OP_HALT                 // 51
+    };
+    ijvm_options opts;
+    default_ijvm_options(&opts);
+    opts.nursery_bytes = 4096;
+    FILE *output_file = tmpfile();
+    ijvm *m = init_program("test_lazy_release.ijvm", constants, 1, text, sizeof(text), &opts,
+                           output_file);
+    assert(m != NULL);
+
+    run_until(m, 15);
+    word inner = tos(m);
+    run_until(m, 31);
+    assert(m->retired.size == 0);
+    step(m);
+    heap_stats stats;
+    get_heap_stats(m, &stats);
+    assert(is_heap_freed(m, inner));
+    assert(stats.live_objects == 0);
+    assert(stats.live_bytes == 0);
+    int backlog = m->retired.size;
+    assert(backlog >= 101);
+
+    // Each minor collection works off a bounded batch
+    long long minors = stats.minor_collections;
+    while (stats.minor_collections == minors && !finished(m)) {
+        step(m);
+        get_heap_stats(m, &stats);
+    }
+    assert(m->retired.size < backlog);
+    assert(m->retired.size > 0);
+
+    // and the next sweep releases whatever is left first
+    run_until(m, 50);
+    assert(m->retired.size > 0);
+    step(m);
+    assert(m->retired.size == 0);
+    run(m);
+    assert(get_halt_reason(m) == IJVM_HALT_NORMAL);
+
+    destroy_ijvm(m);
+    fclose(output_file);
+}
+
+/* a large array gets a mapping of its own: zero-filled, and unmapped once freed */
+void test_large_array(void)
+{
+    word_t constants[] = { 1000000, 999999 };
+    byte_t text[] = {
+        OP_LDC_W, 0x00, 0x00,   // 0
+        OP_NEWARRAY,            // 3
+        OP_ISTORE, 0,           // 4: big
+        OP_LDC_W, 0x00, 0x01,   // 6
+        OP_ILOAD, 0,            // 9
+        OP_IALOAD,              // 11: never written
+        OP_ISTORE, 1,           // 12
+        OP_BIPUSH, 7,           // 14
+        OP_LDC_W, 0x00, 0x01,   // 16
+        OP_ILOAD, 0,            // 19
+        OP_IASTORE,             // 21
+        OP_LDC_W, 0x00, 0x01,   // 22
+        OP_ILOAD, 0,            // 25
+        OP_IALOAD,              // 27
+        OP_ISTORE, 2,           // 28
+        OP_BIPUSH, 0,           // 30
+        OP_ISTORE, 0,           // 32
+        OP_GC,                  // 34
+        OP_GC,                  // 35: releases what the first one retired
+        OP_HALT                 // 36
+    };
+    FILE *output_file = tmpfile();
+    ijvm *m = init_program("test_large_array.ijvm", constants, 2, text, sizeof(text), NULL,
+                           output_file);
+    assert(m != NULL);
+
+    run_until(m, 6);
+    word big = get_local_variable(m, 0);
+    heap_stats stats;
+    get_heap_stats(m, &stats);
+    assert(stats.live_bytes == 4000000);
+    assert(stats.slab_committed_bytes < 4000000);
+    assert(m->slabs.outside == 1);
+
+    run_until(m, 35);
+    assert(get_local_variable(m, 1) == 0);
+    assert(get_local_variable(m, 2) == 7);
+    assert(is_heap_freed(m, big));
+    get_heap_stats(m, &stats);
+    assert(stats.live_bytes == 0);
+    step(m);
+    assert(m->slabs.outside == 0);
+    run(m);
+    assert(get_halt_reason(m) == IJVM_HALT_NORMAL);
+
+    destroy_ijvm(m);
+    fclose(output_file);
+}
+
+int main(void)
+{
+    RUN_TEST(test_stale_reference);
+    RUN_TEST(test_free_garbage_keep_live);
+    RUN_TEST(test_limits);
+    RUN_TEST(test_tailcall_result);
+    RUN_TEST(test_compaction_keeps_contents);
+    RUN_TEST(test_handle_slots_recycled);
+    RUN_TEST(test_handle_table_grows_with_live_set);
+    RUN_TEST(test_incremental_slices);
+    RUN_TEST(test_lazy_release);
+    RUN_TEST(test_large_array);
+    return END_TEST();
+}
@@ -0,0 +1,84 @@
+#include <stdio.h>
+#include <string.h>
+#include "../include/ijvm.h"
+#include "../include/ijvm_ext.h"
+#include "testutil.h"
+#include "testprogram.h"
+
+static word_t loader_constants[] = { 0x12345678, -2 };
+static byte_t loader_text[] = {
+    OP_BIPUSH, 'A',         // 0
+    OP_OUT,                 // 2
+    OP_LDC_W, 0x00, 0x01,   // 3
+    OP_HALT                 // 6
+};
+
+/* the text is used in place, and keeps working after the file is removed */
+void test_text_in_mapping(void)
+{
+    FILE *output_file = tmpfile();
+    ijvm *m = init_program("test_text_in_mapping.ijvm", loader_constants, 2, loader_text,
+                           sizeof(loader_text), NULL, output_file);
+    assert(m != NULL);
+    assert(m->mapping != NULL);
+    byte_t *mapping = m->mapping;
+    assert(get_text(m) >= mapping && get_text(m) < mapping + m->mapping_bytes);
+    assert(get_text_size(m) == sizeof(loader_text));
+    assert(memcmp(get_text(m), loader_text, sizeof(loader_text)) == 0);
+    assert(get_constant(m, 0) == 0x12345678);
+    assert(get_constant(m, 1) == -2);
+
+    run(m);
+    assert(get_halt_reason(m) == IJVM_HALT_NORMAL);
+    assert(tos(m) == -2);
+    rewind(output_file);
+    assert(fgetc(output_file) == 'A');
+
+    destroy_ijvm(m);
+    fclose(output_file);
+}
+
+/* every cut-off prefix of a valid binary is rejected */
+void test_truncated_binaries(void)
+{
+    FILE *f = tmpfile();
+    put_word(f, 0x1DEADFAD);
+    put_word(f, 0x10000);
+    put_word(f, sizeof(loader_constants));
+    put_word(f, (uint32_t)loader_constants[0]);
+    put_word(f, (uint32_t)loader_constants[1]);
+    put_word(f, 0);
+    put_word(f, sizeof(loader_text));
+    fwrite(loader_text, 1, sizeof(loader_text), f);
+    byte_t image[64];
+    rewind(f);
+    size_t size = fread(image, 1, sizeof(image), f);
+    fclose(f);
+
+    for (size_t cut = 0; cut < size; cut++) {
+        f = fopen("test_truncated_binaries.ijvm", "wb");
+        assert(f != NULL);
+        fwrite(image, 1, cut, f);
+        fclose(f);
+        ijvm *m = init_ijvm_std("test_truncated_binaries.ijvm");
+        assert(m == NULL);
+    }
+    remove("test_truncated_binaries.ijvm");
+}
+
+/* files that cannot be mapped go through the read fallback */
+void test_unmappable_file(void)
+{
+    ijvm *m = init_ijvm_std("/dev/null");
+    assert(m == NULL);
+    m = init_ijvm_std("test_missing_binary.ijvm");
+    assert(m == NULL);
+}
+
+int main(void)
+{
+    RUN_TEST(test_text_in_mapping);
+    RUN_TEST(test_truncated_binaries);
+    RUN_TEST(test_unmappable_file);
+    return END_TEST();
+}
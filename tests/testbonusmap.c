@@ -0,0 +1,183 @@
+#include <stdio.h>
+#include "../include/ijvm.h"
+#include "../include/ijvm_ext.h"
+#include "testutil.h"
+#include "testprogram.h"
+
+/* puts, overwrites, lookups, removals and enough keys to grow the table */
+void test_map_operations(void)
+{
+    byte_t text[] = {
+        OP_NEWMAP,              // 0
+        OP_ISTORE, 0,           // 1: map
+        OP_BIPUSH, 10, OP_BIPUSH, 1, OP_ILOAD, 0, OP_MAPPUT,  // 3: map[1] = 10
+        OP_BIPUSH, 11, OP_BIPUSH, 1, OP_ILOAD, 0, OP_MAPPUT,  // 10: map[1] = 11
+        OP_BIPUSH, 20, OP_BIPUSH, 2, OP_ILOAD, 0, OP_MAPPUT,  // 17: map[2] = 20
+        OP_BIPUSH, 1, OP_ILOAD, 0, OP_MAPGET, OP_ISTORE, 1,   // 24
+        OP_BIPUSH, 3, OP_ILOAD, 0, OP_MAPGET, OP_ISTORE, 2,   // 31: absent
+        OP_BIPUSH, 2, OP_ILOAD, 0, OP_MAPREMOVE, OP_ISTORE, 3, // 38
+        OP_BIPUSH, 2, OP_ILOAD, 0, OP_MAPREMOVE, OP_ISTORE, 4, // 45: already gone
+        OP_ILOAD, 0, OP_MAPSIZE, OP_ISTORE, 5,                // 52
+        OP_BIPUSH, 22, OP_BIPUSH, 2, OP_ILOAD, 0, OP_MAPPUT,  // 57: over the tombstone
+        OP_BIPUSH, 2, OP_ILOAD, 0, OP_MAPGET, OP_ISTORE, 6,   // 64
+        OP_ILOAD, 9,            // 71: put loop
+        OP_BIPUSH, 100,         // 73
+        OP_IF_ICMPEQ, 0x00, 0x13, // 75
+        OP_ILOAD, 9,            // 78
+        OP_BIPUSH, 100,         // 80
+        OP_IADD,                // 82
+        OP_ILOAD, 9,            // 83
+        OP_ILOAD, 0,            // 85
+        OP_MAPPUT,              // 87: map[i] = i + 100
+        OP_IINC, 9, 1,          // 88
+        OP_GOTO, 0xFF, 0xEC,    // 91
+        OP_BIPUSH, 0,           // 94
+        OP_ISTORE, 9,           // 96
+        OP_ILOAD, 9,            // 98: sum loop
+        OP_BIPUSH, 100,         // 100
+        OP_IF_ICMPEQ, 0x00, 0x13, // 102
+        OP_ILOAD, 7,            // 105
+        OP_ILOAD, 9,            // 107
+        OP_ILOAD, 0,            // 109
+        OP_MAPGET,              // 111
+        OP_IADD,                // 112
+        OP_ISTORE, 7,           // 113
+        OP_IINC, 9, 1,          // 115
+        OP_GOTO, 0xFF, 0xEC,    // 118
+        OP_ILOAD, 0,            // 121
+        OP_MAPSIZE,             // 123
+        OP_ISTORE, 8,           // 124
+        OP_HALT                 // 126
+    };
+    FILE *output_file = tmpfile();
+    ijvm *m = init_program("test_map_operations.ijvm", NULL, 0, text, sizeof(text), NULL,
+                           output_file);
+    assert(m != NULL);
+    run(m);
+    assert(get_halt_reason(m) == IJVM_HALT_NORMAL);
+    assert(get_local_variable(m, 1) == 11);
+    assert(get_local_variable(m, 2) == 0);
+    assert(get_local_variable(m, 3) == 1);
+    assert(get_local_variable(m, 4) == 0);
+    assert(get_local_variable(m, 5) == 1);
+    assert(get_local_variable(m, 6) == 22);
+    assert(get_local_variable(m, 7) == 4950 + 100 * 100);
+    assert(get_local_variable(m, 8) == 100);
+
+    destroy_ijvm(m);
+    fclose(output_file);
+}
+
+/* an array stored as a map value lives as long as the entry does */
+void test_map_keeps_values(void)
+{
+    byte_t text[] = {
+        OP_NEWMAP,              // 0
+        OP_ISTORE, 0,           // 1: map
+        OP_BIPUSH, 3,           // 3
+        OP_NEWARRAY,            // 5
+        OP_ISTORE, 1,           // 6: array
+        OP_BIPUSH, 42,          // 8
+        OP_BIPUSH, 2,           // 10
+        OP_ILOAD, 1,            // 12
+        OP_IASTORE,             // 14: array[2] = 42
+        OP_ILOAD, 1,            // 15
+        OP_BIPUSH, 5,           // 17
+        OP_ILOAD, 0,            // 19
+        OP_MAPPUT,              // 21: map[5] = array
+        OP_BIPUSH, 0,           // 22
+        OP_ISTORE, 1,           // 24
+        OP_GC,                  // 26
+        OP_BIPUSH, 2,           // 27
+        OP_BIPUSH, 5,           // 29
+        OP_ILOAD, 0,            // 31
+        OP_MAPGET,              // 33
+        OP_IALOAD,              // 34: map[5][2]
+        OP_ISTORE, 2,           // 35
+        OP_BIPUSH, 5,           // 37
+        OP_ILOAD, 0,            // 39
+        OP_MAPREMOVE,           // 41
+        OP_POP,                 // 42
+        OP_GC,                  // 43
+        OP_HALT                 // 44
+    };
+    FILE *output_file = tmpfile();
+    ijvm *m = init_program("test_map_keeps_values.ijvm", NULL, 0, text, sizeof(text), NULL,
+                           output_file);
+    assert(m != NULL);
+
+    run_until(m, 22);
+    word array = get_local_variable(m, 1);
+    run_until(m, 27);
+    assert(!is_heap_freed(m, array));
+    run(m);
+    assert(get_halt_reason(m) == IJVM_HALT_NORMAL);
+    assert(get_local_variable(m, 2) == 42);
+    assert(is_heap_freed(m, array));
+
+    destroy_ijvm(m);
+    fclose(output_file);
+}
+
+/* growing the table counts against the heap budget like any allocation */
+void test_map_heap_limit(void)
+{
+    byte_t text[] = {
+        OP_NEWMAP,              // 0
+        OP_ISTORE, 0,           // 1
+        OP_ILOAD, 1,            // 3
+        OP_ILOAD, 1,            // 5
+        OP_ILOAD, 0,            // 7
+        OP_MAPPUT,              // 9: map[i] = i
+        OP_IINC, 1, 1,          // 10
+        OP_GOTO, 0xFF, 0xF6     // 13
+    };
+    ijvm_options opts;
+    default_ijvm_options(&opts);
+    opts.limits.max_heap_bytes = 4096;
+    opts.limits.max_instructions = 1000000;
+    FILE *output_file = tmpfile();
+    ijvm *m = init_program("test_map_heap_limit.ijvm", NULL, 0, text, sizeof(text), &opts,
+                           output_file);
+    assert(m != NULL);
+    run(m);
+    assert(get_halt_reason(m) == IJVM_HALT_HEAP_LIMIT);
+
+    destroy_ijvm(m);
+    fclose(output_file);
+}
+
+/* a map only an untagged word refers to may go in the collection MAPPUT starts */
+void test_map_untagged_reference(void)
+{
+    byte_t text[] = {
+        OP_BIPUSH, 1,           // 0
+        OP_BIPUSH, 1,           // 2
+        OP_NEWMAP,              // 4
+        OP_BIPUSH, 0,           // 5
+        OP_IADD,                // 7: drops the tag
+        OP_MAPPUT,              // 8
+        OP_HALT                 // 9
+    };
+    ijvm_options opts;
+    default_ijvm_options(&opts);
+    opts.limits.max_heap_bytes = 100;
+    FILE *output_file = tmpfile();
+    ijvm *m = init_program("test_map_untagged_reference.ijvm", NULL, 0, text, sizeof(text),
+                           &opts, output_file);
+    assert(m != NULL);
+    run(m);
+    assert(get_halt_reason(m) == IJVM_HALT_ERROR);
+
+    destroy_ijvm(m);
+    fclose(output_file);
+}
+
+int main(void)
+{
+    RUN_TEST(test_map_operations);
+    RUN_TEST(test_map_keeps_values);
+    RUN_TEST(test_map_heap_limit);
+    RUN_TEST(test_map_untagged_reference);
+    return END_TEST();
+}
@@ -0,0 +1,106 @@
+#include <stdio.h>
+#include <string.h>
+#include "../include/ijvm.h"
+#include "../include/ijvm_ext.h"
+#include "testutil.h"
+#include "testprogram.h"
+
+/* one array that stays alive, then ten short-lived ones from another site */
+static byte_t sites_text[] = {
+    OP_BIPUSH, 3,           // 0
+    OP_NEWARRAY,            // 2: kept
+    OP_ISTORE, 0,           // 3
+    OP_ILOAD, 1,            // 5: loop
+    OP_BIPUSH, 10,          // 7
+    OP_IF_ICMPEQ, 0x00, 0x0D, // 9
+    OP_BIPUSH, 2,           // 12
+    OP_NEWARRAY,            // 14: garbage
+    OP_POP,                 // 15
+    OP_IINC, 1, 1,          // 16
+    OP_GOTO, 0xFF, 0xF2,    // 19
+    OP_GC,                  // 22
+    OP_HALT                 // 23
+};
+
+/* dumps the profile of m and reads it back into buf */
+static void read_profile(ijvm *m, char *buf, size_t size)
+{
+    FILE *f = tmpfile();
+    dump_heap_profile(m, f);
+    rewind(f);
+    size_t n = fread(buf, 1, size - 1, f);
+    buf[n] = '\0';
+    fclose(f);
+}
+
+/* dumps on demand show the sites' live bytes before and after a collection */
+void test_profile_on_demand(void)
+{
+    ijvm_options opts;
+    default_ijvm_options(&opts);
+    opts.heap_profile = true;
+    FILE *output_file = tmpfile();
+    ijvm *m = init_program("test_profile_on_demand.ijvm", NULL, 0, sites_text,
+                           sizeof(sites_text), &opts, output_file);
+    assert(m != NULL);
+
+    char profile[1024];
+    run_until(m, 22);
+    read_profile(m, profile, sizeof(profile));
+    assert(strstr(profile, "live_bytes;main;alloc@0x0002 12\n") != NULL);
+    assert(strstr(profile, "allocations;main;alloc@0x0002 1\n") != NULL);
+    assert(strstr(profile, "live_bytes;main;alloc@0x000e 80\n") != NULL);
+    assert(strstr(profile, "allocations;main;alloc@0x000e 10\n") != NULL);
+
+    run(m);
+    assert(get_halt_reason(m) == IJVM_HALT_NORMAL);
+    read_profile(m, profile, sizeof(profile));
+    assert(strstr(profile, "live_bytes;main;alloc@0x0002 12\n") != NULL);
+    assert(strstr(profile, "live_bytes;main;alloc@0x000e 0\n") != NULL);
+    assert(strstr(profile, "allocations;main;alloc@0x000e 10\n") != NULL);
+    // The i-th garbage array saw 10 - i later allocations
+    assert(strstr(profile, "avg_lifetime;main;alloc@0x000e 5\n") != NULL);
+
+    destroy_ijvm(m);
+    fclose(output_file);
+}
+
+/* heap_profile_out receives the final profile; without profiling nothing is written */
+void test_profile_at_exit(void)
+{
+    ijvm_options opts;
+    default_ijvm_options(&opts);
+    FILE *output_file = tmpfile();
+    ijvm *m = init_program("test_profile_at_exit.ijvm", NULL, 0, sites_text,
+                           sizeof(sites_text), &opts, output_file);
+    assert(m != NULL);
+    run(m);
+    char profile[1024];
+    read_profile(m, profile, sizeof(profile));
+    assert(profile[0] == '\0');
+    destroy_ijvm(m);
+
+    FILE *profile_file = tmpfile();
+    opts.heap_profile = true;
+    opts.heap_profile_out = profile_file;
+    m = init_program("test_profile_at_exit.ijvm", NULL, 0, sites_text, sizeof(sites_text),
+                     &opts, output_file);
+    assert(m != NULL);
+    run(m);
+    assert(ftell(profile_file) == 0);
+    destroy_ijvm(m);
+    rewind(profile_file);
+    size_t n = fread(profile, 1, sizeof(profile) - 1, profile_file);
+    profile[n] = '\0';
+    assert(strstr(profile, "allocations;main;alloc@0x000e 10\n") != NULL);
+
+    fclose(profile_file);
+    fclose(output_file);
+}
+
+int main(void)
+{
+    RUN_TEST(test_profile_on_demand);
+    RUN_TEST(test_profile_at_exit);
+    return END_TEST();
+}
@@ -0,0 +1,184 @@
+#include <stdio.h>
+#include "../include/ijvm.h"
+#include "../include/ijvm_ext.h"
+#include "testutil.h"
+#include "testprogram.h"
+
+/* reference counting that reconciles before every allocation */
+static ijvm *init_counting(char *path, const byte_t *text, int text_size, FILE *output)
+{
+    ijvm_options opts;
+    default_ijvm_options(&opts);
+    opts.reference_counting = true;
+    opts.rc_batch_objects = 1;
+    return init_program(path, NULL, 0, text, text_size, &opts, output);
+}
+
+/* arrays only the stack refers to have a zero count but are not freed */
+void test_stack_only_survives(void)
+{
+    byte_t text[] = {
+        OP_BIPUSH, 3,           // 0
+        OP_NEWARRAY,            // 2
+        OP_ISTORE, 0,           // 3: only in a local
+        OP_BIPUSH, 3,           // 5
+        OP_NEWARRAY,            // 7: only on the operand stack
+        OP_ILOAD, 1,            // 8: churn loop
+        OP_BIPUSH, 20,          // 10
+        OP_IF_ICMPEQ, 0x00, 0x0D, // 12
+        OP_BIPUSH, 2,           // 15
+        OP_NEWARRAY,            // 17
+        OP_POP,                 // 18
+        OP_IINC, 1, 1,          // 19
+        OP_GOTO, 0xFF, 0xF2,    // 22
+        OP_HALT                 // 25
+    };
+    FILE *output_file = tmpfile();
+    ijvm *m = init_counting("test_stack_only_survives.ijvm", text, sizeof(text), output_file);
+    assert(m != NULL);
+
+    run_until(m, 8);
+    word local = get_local_variable(m, 0);
+    word operand = tos(m);
+    run_until(m, 18);
+    word garbage = tos(m);
+    run(m);
+    assert(get_halt_reason(m) == IJVM_HALT_NORMAL);
+
+    heap_stats stats;
+    get_heap_stats(m, &stats);
+    assert(stats.reconciliations > 0);
+    assert(stats.full_collections == 0);
+    assert(!is_heap_freed(m, local));
+    assert(!is_heap_freed(m, operand));
+    assert(is_heap_freed(m, garbage));
+
+    destroy_ijvm(m);
+    fclose(output_file);
+}
+
+/* counts never drop to zero in a cycle, so the full collection frees it */
+void test_cycle_freed_by_collection(void)
+{
+    byte_t text[] = {
+        OP_BIPUSH, 1,           // 0
+        OP_NEWARRAY,            // 2
+        OP_ISTORE, 0,           // 3: a
+        OP_BIPUSH, 1,           // 5
+        OP_NEWARRAY,            // 7
+        OP_ISTORE, 1,           // 8: b
+        OP_ILOAD, 1,            // 10
+        OP_BIPUSH, 0,           // 12
+        OP_ILOAD, 0,            // 14
+        OP_IASTORE,             // 16: a[0] = b
+        OP_ILOAD, 0,            // 17
+        OP_BIPUSH, 0,           // 19
+        OP_ILOAD, 1,            // 21
+        OP_IASTORE,             // 23: b[0] = a
+        OP_BIPUSH, 0,           // 24
+        OP_ISTORE, 0,           // 26
+        OP_BIPUSH, 0,           // 28
+        OP_ISTORE, 1,           // 30
+        OP_BIPUSH, 1,           // 32
+        OP_NEWARRAY,            // 34
+        OP_POP,                 // 35
+        OP_BIPUSH, 1,           // 36
+        OP_NEWARRAY,            // 38
+        OP_POP,                 // 39
+        OP_GC,                  // 40
+        OP_HALT                 // 41
+    };
+    FILE *output_file = tmpfile();
+    ijvm *m = init_counting("test_cycle_freed_by_collection.ijvm", text, sizeof(text),
+                            output_file);
+    assert(m != NULL);
+
+    run_until(m, 24);
+    word a = get_local_variable(m, 0);
+    word b = get_local_variable(m, 1);
+    run_until(m, 40);
+    heap_stats stats;
+    get_heap_stats(m, &stats);
+    assert(stats.reconciliations > 0);
+    assert(!is_heap_freed(m, a));
+    assert(!is_heap_freed(m, b));
+
+    step(m);
+    assert(is_heap_freed(m, a));
+    assert(is_heap_freed(m, b));
+    run(m);
+    assert(get_halt_reason(m) == IJVM_HALT_NORMAL);
+
+    destroy_ijvm(m);
+    fclose(output_file);
+}
+
+/* ARRAYCOPY, ARRAYFILL and MAPPUT count the references they add and drop */
+void test_bulk_ops_balance_counts(void)
+{
+    byte_t text[] = {
+        OP_BIPUSH, 1, OP_NEWARRAY, OP_ISTORE, 0,    // 0: x
+        OP_BIPUSH, 1, OP_NEWARRAY, OP_ISTORE, 1,    // 5: y
+        OP_BIPUSH, 2, OP_NEWARRAY, OP_ISTORE, 2,    // 10: holder
+        OP_BIPUSH, 2, OP_NEWARRAY, OP_ISTORE, 3,    // 15: copy
+        OP_NEWMAP, OP_ISTORE, 4,                    // 20: map
+        OP_ILOAD, 0, OP_BIPUSH, 0, OP_ILOAD, 2, OP_IASTORE, // 23: holder[0] = x
+        OP_ILOAD, 1, OP_BIPUSH, 1, OP_ILOAD, 2, OP_IASTORE, // 30: holder[1] = y
+        OP_BIPUSH, 0, OP_ISTORE, 0,                 // 37
+        OP_BIPUSH, 0, OP_ISTORE, 1,                 // 41
+        OP_ILOAD, 2, OP_BIPUSH, 0, OP_ILOAD, 3,     // 45
+        OP_BIPUSH, 0, OP_BIPUSH, 2, OP_ARRAYCOPY,   // 51: copy = holder
+        OP_ILOAD, 2, OP_BIPUSH, 0, OP_BIPUSH, 2,    // 56
+        OP_BIPUSH, 0, OP_ARRAYFILL,                 // 62: holder = 0, 0
+        OP_BIPUSH, 1, OP_NEWARRAY, OP_POP,          // 65
+        OP_BIPUSH, 1, OP_NEWARRAY, OP_POP,          // 69
+        OP_BIPUSH, 0, OP_ILOAD, 3, OP_IALOAD,       // 73
+        OP_BIPUSH, 1, OP_ILOAD, 4, OP_MAPPUT,       // 78: map[1] = x
+        OP_BIPUSH, 1, OP_ILOAD, 3, OP_IALOAD,       // 83
+        OP_BIPUSH, 1, OP_ILOAD, 4, OP_MAPPUT,       // 88: map[1] = y
+        OP_ILOAD, 3, OP_BIPUSH, 0, OP_BIPUSH, 2,    // 93
+        OP_BIPUSH, 0, OP_ARRAYFILL,                 // 99: copy = 0, 0
+        OP_BIPUSH, 1, OP_NEWARRAY, OP_POP,          // 102
+        OP_BIPUSH, 1, OP_NEWARRAY, OP_POP,          // 106
+        OP_BIPUSH, 1, OP_ILOAD, 4, OP_MAPREMOVE, OP_POP, // 110
+        OP_BIPUSH, 1, OP_NEWARRAY, OP_POP,          // 116
+        OP_BIPUSH, 1, OP_NEWARRAY, OP_POP,          // 120
+        OP_HALT                                     // 124
+    };
+    FILE *output_file = tmpfile();
+    ijvm *m = init_counting("test_bulk_ops_balance_counts.ijvm", text, sizeof(text),
+                            output_file);
+    assert(m != NULL);
+
+    run_until(m, 10);
+    word x = get_local_variable(m, 0);
+    word y = get_local_variable(m, 1);
+
+    // Only copy refers to them now
+    run_until(m, 73);
+    assert(!is_heap_freed(m, x));
+    assert(!is_heap_freed(m, y));
+
+    // Replacing map[1] dropped x; y is still in the map
+    run_until(m, 110);
+    assert(is_heap_freed(m, x));
+    assert(!is_heap_freed(m, y));
+
+    run(m);
+    assert(get_halt_reason(m) == IJVM_HALT_NORMAL);
+    assert(is_heap_freed(m, y));
+    heap_stats stats;
+    get_heap_stats(m, &stats);
+    assert(stats.full_collections == 0);
+
+    destroy_ijvm(m);
+    fclose(output_file);
+}
+
+int main(void)
+{
+    RUN_TEST(test_stack_only_survives);
+    RUN_TEST(test_cycle_freed_by_collection);
+    RUN_TEST(test_bulk_ops_balance_counts);
+    return END_TEST();
+}
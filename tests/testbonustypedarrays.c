@@ -0,0 +1,78 @@
+#include <stdio.h>
+#include "../include/ijvm.h"
+#include "../include/ijvm_ext.h"
+#include "testutil.h"
+#include "testprogram.h"
+
+/*
+ * Stores value into element 1 of a new 4-element array of the given type
+ * with store_op, loads it back with load_op and returns what ended up on
+ * top of the stack. The halt reason goes to *reason.
+ */
+static word round_trip(byte_t type, byte_t store_op, byte_t load_op, word_t value,
+                       ijvm_halt_reason *reason)
+{
+    word_t constants[] = { value };
+    byte_t text[] = {
+        OP_BIPUSH, 4,           // 0
+        OP_NEWTARRAY, type,     // 2
+        OP_ISTORE, 0,           // 4
+        OP_LDC_W, 0x00, 0x00,   // 6
+        OP_BIPUSH, 1,           // 9
+        OP_ILOAD, 0,            // 11
+        store_op,               // 13
+        OP_BIPUSH, 1,           // 14
+        OP_ILOAD, 0,            // 16
+        load_op,                // 18
+        OP_HALT                 // 19
+    };
+    FILE *output_file = tmpfile();
+    ijvm *m = init_program("test_typed_arrays.ijvm", constants, 1, text, sizeof(text),
+                           NULL, output_file);
+    assert(m != NULL);
+    run(m);
+    word result = tos(m);
+    *reason = get_halt_reason(m);
+    destroy_ijvm(m);
+    fclose(output_file);
+    return result;
+}
+
+/* loads sign- or zero-extend and stores truncate as the element type says */
+void test_typed_round_trip(void)
+{
+    ijvm_halt_reason reason;
+
+    assert(round_trip(ATYPE_BYTE, OP_BASTORE, OP_BALOAD, 200, &reason) == -56);
+    assert(reason == IJVM_HALT_NORMAL);
+    assert(round_trip(ATYPE_UBYTE, OP_BASTORE, OP_BALOAD, 200, &reason) == 200);
+    assert(round_trip(ATYPE_UBYTE, OP_BASTORE, OP_BALOAD, -1, &reason) == 255);
+    assert(round_trip(ATYPE_BYTE, OP_BASTORE, OP_BALOAD, 0x1234, &reason) == 0x34);
+    assert(round_trip(ATYPE_SHORT, OP_SASTORE, OP_SALOAD, 40000, &reason) == -25536);
+    assert(round_trip(ATYPE_CHAR, OP_SASTORE, OP_SALOAD, 40000, &reason) == 40000);
+    assert(round_trip(ATYPE_CHAR, OP_SASTORE, OP_SALOAD, 0x12345, &reason) == 0x2345);
+    assert(round_trip(ATYPE_INT, OP_IASTORE, OP_IALOAD, 0x12345678, &reason) == 0x12345678);
+    assert(reason == IJVM_HALT_NORMAL);
+}
+
+/* loads and stores only accept arrays of their own element width */
+void test_typed_wrong_width(void)
+{
+    ijvm_halt_reason reason;
+
+    round_trip(ATYPE_BYTE, OP_BASTORE, OP_IALOAD, 1, &reason);
+    assert(reason == IJVM_HALT_ERROR);
+    round_trip(ATYPE_INT, OP_IASTORE, OP_BALOAD, 1, &reason);
+    assert(reason == IJVM_HALT_ERROR);
+    round_trip(ATYPE_SHORT, OP_BASTORE, OP_SALOAD, 1, &reason);
+    assert(reason == IJVM_HALT_ERROR);
+    round_trip(ATYPE_CHAR, OP_SASTORE, OP_BALOAD, 1, &reason);
+    assert(reason == IJVM_HALT_ERROR);
+}
+
+int main(void)
+{
+    RUN_TEST(test_typed_round_trip);
+    RUN_TEST(test_typed_wrong_width);
+    return END_TEST();
+}
@@ -0,0 +1,109 @@
+#include <stdint.h>
+#include <stdio.h>
+#include "../include/ijvm.h"
+#include "../include/ijvm_ext.h"
+#include "testutil.h"
+#include "testprogram.h"
+
+#define N 37
+
+/* vector results match the same computation done one element at a time */
+void test_vector_matches_scalar(void)
+{
+    // v flips between K and -K; a and b spread around it, so a + b wraps
+    word_t constants[] = { 0x7FFFFF00 };
+    byte_t text[] = {
+        OP_BIPUSH, N, OP_NEWARRAY, OP_ISTORE, 0,        // 0: a
+        OP_BIPUSH, N, OP_NEWARRAY, OP_ISTORE, 1,        // 5: b
+        OP_BIPUSH, N, OP_NEWARRAY, OP_ISTORE, 2,        // 10: c
+        OP_LDC_W, 0x00, 0x00, OP_ISTORE, 4,             // 15: v = K
+        OP_ILOAD, 3,                                    // 20: fill loop
+        OP_BIPUSH, N,                                   // 22
+        OP_IF_ICMPEQ, 0x00, 0x24,                       // 24
+        OP_BIPUSH, 0, OP_ILOAD, 4, OP_ISUB, OP_ISTORE, 4, // 27: v = -v
+        OP_ILOAD, 4, OP_ILOAD, 3, OP_IADD,              // 34
+        OP_ILOAD, 3, OP_ILOAD, 0, OP_IASTORE,           // 39: a[i] = v + i
+        OP_ILOAD, 4, OP_ILOAD, 3, OP_ISUB,              // 44
+        OP_ILOAD, 3, OP_ILOAD, 1, OP_IASTORE,           // 49: b[i] = v - i
+        OP_IINC, 3, 1,                                  // 54
+        OP_GOTO, 0xFF, 0xDB,                            // 57
+        OP_ILOAD, 0, OP_ILOAD, 1, OP_ILOAD, 2,          // 60
+        OP_BIPUSH, 0, OP_BIPUSH, N, OP_VECOP, VEC_ADD,  // 66: c = a + b
+        OP_ILOAD, 2, OP_BIPUSH, 0, OP_BIPUSH, N,        // 72
+        OP_VECREDUCE, VEC_SUM, OP_ISTORE, 5,            // 78
+        OP_ILOAD, 0, OP_ILOAD, 1, OP_ILOAD, 2,          // 82
+        OP_BIPUSH, 3, OP_BIPUSH, 30, OP_VECOP, VEC_SUB, // 88: c[3..33) = a - b
+        OP_ILOAD, 2, OP_BIPUSH, 0, OP_BIPUSH, N,        // 94
+        OP_VECREDUCE, VEC_SUM, OP_ISTORE, 6,            // 100
+        OP_ILOAD, 0, OP_BIPUSH, 0, OP_BIPUSH, N,        // 104
+        OP_VECREDUCE, VEC_MIN, OP_ISTORE, 7,            // 110
+        OP_ILOAD, 1, OP_BIPUSH, 5, OP_BIPUSH, 30,       // 114
+        OP_VECREDUCE, VEC_MAX, OP_ISTORE, 8,            // 120
+        OP_ILOAD, 0, OP_ILOAD, 1, OP_ILOAD, 2,          // 124
+        OP_BIPUSH, 0, OP_BIPUSH, N, OP_VECOP, VEC_AND,  // 130: c = a & b
+        OP_ILOAD, 2, OP_BIPUSH, 0, OP_BIPUSH, N,        // 136
+        OP_VECREDUCE, VEC_SUM, OP_ISTORE, 9,            // 142
+        OP_HALT                                         // 146
+    };
+
+    // The same steps on unsigned words, which wrap like the machine does
+    uint32_t a[N], b[N], c[N];
+    int32_t v = constants[0];
+    int32_t min_a = INT32_MAX, max_b = INT32_MIN;
+    for (int i = 0; i < N; i++) {
+        v = -v;
+        a[i] = (uint32_t)(v + i);
+        b[i] = (uint32_t)(v - i);
+        if (v + i < min_a) min_a = v + i;
+        if (i >= 5 && i < 35 && v - i > max_b) max_b = v - i;
+    }
+    uint32_t sum_add = 0, sum_sub = 0, sum_and = 0;
+    for (int i = 0; i < N; i++) {
+        c[i] = a[i] + b[i];
+        sum_add += c[i];
+    }
+    for (int i = 3; i < 33; i++) c[i] = a[i] - b[i];
+    for (int i = 0; i < N; i++) sum_sub += c[i];
+    for (int i = 0; i < N; i++) sum_and += a[i] & b[i];
+
+    FILE *output_file = tmpfile();
+    ijvm *m = init_program("test_vector.ijvm", constants, 1, text, sizeof(text), NULL,
+                           output_file);
+    assert(m != NULL);
+    run(m);
+    assert(get_halt_reason(m) == IJVM_HALT_NORMAL);
+    assert(get_local_variable(m, 5) == (word)sum_add);
+    assert(get_local_variable(m, 6) == (word)sum_sub);
+    assert(get_local_variable(m, 7) == min_a);
+    assert(get_local_variable(m, 8) == max_b);
+    assert(get_local_variable(m, 9) == (word)sum_and);
+
+    destroy_ijvm(m);
+    fclose(output_file);
+}
+
+/* a range past the end of an operand is an error */
+void test_vector_bad_range(void)
+{
+    byte_t text[] = {
+        OP_BIPUSH, 8, OP_NEWARRAY, OP_ISTORE, 0,
+        OP_ILOAD, 0, OP_ILOAD, 0, OP_ILOAD, 0,
+        OP_BIPUSH, 4, OP_BIPUSH, 5, OP_VECOP, VEC_ADD,
+        OP_HALT
+    };
+    FILE *output_file = tmpfile();
+    ijvm *m = init_program("test_vector_bad_range.ijvm", NULL, 0, text, sizeof(text), NULL,
+                           output_file);
+    assert(m != NULL);
+    run(m);
+    assert(get_halt_reason(m) == IJVM_HALT_ERROR);
+    destroy_ijvm(m);
+    fclose(output_file);
+}
+
+int main(void)
+{
+    RUN_TEST(test_vector_matches_scalar);
+    RUN_TEST(test_vector_bad_range);
+    return END_TEST();
+}
@@ -0,0 +1,54 @@
+#ifndef TESTPROGRAM_H
+#define TESTPROGRAM_H
+#include <stdio.h>
+#include "../include/ijvm.h"
+#include "../include/ijvm_ext.h"
+
+/**
+ * Helpers for tests that build their program inline instead of loading a
+ * binary from files/. Branch offsets in the text are relative to the
+ * branch instruction, as in the assembler output.
+ **/
+
+static inline void put_word(FILE *f, uint32_t value)
+{
+    byte_t bytes[4] = {
+        (byte_t)(value >> 24), (byte_t)(value >> 16), (byte_t)(value >> 8), (byte_t)value
+    };
+    fwrite(bytes, 1, sizeof(bytes), f);
+}
+
+/**
+ * Writes a binary with the given constant pool and text to path and starts
+ * a machine on it with opts (NULL for the defaults). The file is removed
+ * again right away.
+ **/
+static inline ijvm *init_program(char *path, const word_t *constants, int constant_count,
+                                 const byte_t *text, int text_size, const ijvm_options *opts,
+                                 FILE *output)
+{
+    FILE *f = fopen(path, "wb");
+    if (f == NULL) return NULL;
+    put_word(f, 0x1DEADFAD);
+    put_word(f, 0x10000);
+    put_word(f, (uint32_t)constant_count * 4);
+    for (int i = 0; i < constant_count; i++) put_word(f, (uint32_t)constants[i]);
+    put_word(f, 0);
+    put_word(f, (uint32_t)text_size);
+    fwrite(text, 1, (size_t)text_size, f);
+    fclose(f);
+
+    ijvm *m = init_ijvm_with_options(path, stdin, output, opts);
+    remove(path);
+    return m;
+}
+
+/**
+ * Steps until the program counter reaches pc or the machine stops.
+ **/
+static inline void run_until(ijvm *m, int pc)
+{
+    while (!finished(m) && get_program_counter(m) != pc) step(m);
+}
+
+#endif